@@ -0,0 +1,184 @@
+#ifndef SIMPLE_DAQ_OFFLINE_INCLUDE_MIDAS_FILE_HH_
+#define SIMPLE_DAQ_OFFLINE_INCLUDE_MIDAS_FILE_HH_
+
+/*===========================================================================*\
+
+file:   midas_file.hh
+
+about:  Reads the events and banks of the files mlogger writes,
+        run%05dsub%03d.mid and .mid.gz, without MIDAS itself.
+
+        Plain files are mapped and events point straight into the
+        mapping, so the traces in the 16_N and 02_N banks are read in
+        place and stay valid while the file is open.  Compressed files
+        are streamed through zlib, one event at a time, and an event is
+        only valid until the next call to Next.
+
+        ForEachEvent spreads the subruns of a run over threads, each
+        thread reads whole files in order.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+
+//--- other includes --------------------------------------------------------//
+#include <zlib.h>
+
+namespace offline {
+
+// The on-disk layout, as in midas.h.
+struct event_header {
+  uint16_t event_id;
+  uint16_t trigger_mask;
+  uint32_t serial_number;
+  uint32_t time_stamp;
+  uint32_t data_size;
+};
+
+struct bank_header {
+  uint32_t data_size;
+  uint32_t flags;
+};
+
+const uint32_t kBankFormat32Bit = 1 << 4;
+const uint32_t kBankFormat64BitAligned = 1 << 5;
+
+// Past any event buffer, a larger data_size means a corrupt header.
+const uint32_t kMaxEventSize = 1 << 28;
+
+// Begin and end of run ODB dumps and messages carry no banks.
+const uint16_t kEventIdBor = 0x8000;
+const uint16_t kEventIdEor = 0x8001;
+const uint16_t kEventIdMessage = 0x8002;
+
+// MIDAS type ids of the banks we read.
+const uint16_t kTidWord = 4;
+const uint16_t kTidFloat = 9;
+const uint16_t kTidDouble = 10;
+
+// A read-only view of contiguous data, like std::span.
+template <typename T>
+class Span {
+ public:
+  Span() : data_(nullptr), size_(0) {};
+  Span(const T *data, size_t size) : data_(data), size_(size) {};
+
+  const T *data() const { return data_; };
+  size_t size() const { return size_; };
+  bool empty() const { return size_ == 0; };
+
+  const T *begin() const { return data_; };
+  const T *end() const { return data_ + size_; };
+  const T &operator[](size_t i) const { return data_[i]; };
+
+  // count elements from offset, cut at the end.
+  Span<T> subspan(size_t offset, size_t count) const {
+    if (offset > size_) offset = size_;
+    if (count > size_ - offset) count = size_ - offset;
+    return Span<T>(data_ + offset, count);
+  };
+
+ private:
+  const T *data_;
+  size_t size_;
+};
+
+struct bank {
+  char name[5];
+  uint32_t type;
+  Span<char> data;
+
+  // The payload as elements of T, the type is not checked.
+  template <typename T>
+  Span<T> as() const {
+    return Span<T>((const T *)data.data(), data.size() / sizeof(T));
+  };
+};
+
+class Event {
+ public:
+  Event() : header_(nullptr) {};
+  Event(const event_header *header) : header_(header) {};
+
+  const event_header &header() const { return *header_; };
+  uint16_t id() const { return header_->event_id; };
+  uint32_t serial() const { return header_->serial_number; };
+  uint32_t time() const { return header_->time_stamp; };
+
+  // False for ODB dumps and messages.
+  bool has_banks() const;
+
+  // Calls f on each bank in order, stop early by returning false.
+  void ForEachBank(const std::function<bool(const bank&)>& f) const;
+
+  bool FindBank(const char *name, bank& b) const;
+  std::vector<bank> Banks() const;
+
+  // The samples of a 16_N or 02_N bank, channel after channel, empty if
+  // the event doesn't have the bank.
+  Span<uint16_t> Trace(const char *name) const;
+
+ private:
+  const event_header *header_;
+};
+
+// The samples of one channel in a board trace of len samples per channel.
+inline Span<uint16_t> Channel(Span<uint16_t> trace, int ch, int len)
+{
+  return trace.subspan((size_t)ch * len, len);
+}
+
+class MidasFile {
+ public:
+  MidasFile();
+  ~MidasFile();
+
+  // Open a .mid or .mid.gz file, false on failure, see error().
+  bool Open(const std::string& path);
+  void Close();
+
+  // The next event, false at the end of the file or on a truncated
+  // event.  With BOR, EOR and message events too if all is set.
+  bool Next(Event& event, bool all=false);
+  void Rewind();
+
+  // Bytes of events read so far, uncompressed.
+  size_t bytes_read() const { return bytes_read_; };
+  bool mapped() const { return map_ != nullptr; };
+
+  const std::string& error() const { return error_; };
+
+ private:
+  std::string path_;
+  std::string error_;
+
+  // Mapped files.
+  const char *map_;
+  size_t map_size_;
+  size_t offset_;
+
+  // Compressed files.
+  gzFile gz_;
+  std::vector<char> buffer_;
+
+  size_t bytes_read_;
+};
+
+// The subrun files of a run in a directory, in subrun order.
+std::vector<std::string> SubrunFiles(const std::string& dir, int run);
+
+// Read the files on num_threads threads, f gets the index of the file
+// and the event, and is called concurrently.  Returns the number of
+// events, or -1 if a file could not be opened or read to its end.
+long long ForEachEvent(const std::vector<std::string>& files, int num_threads,
+                      const std::function<void(int, const Event&)>& f);
+
+} // ::offline
+
+#endif
@@ -0,0 +1,218 @@
+/*---------------------------------------------------------------------------*\
+file:   bm_midas_read.cxx
+
+about:  Read-throughput benchmark of the offline MIDAS reader against
+        the ROOT trees of the same run.  It scans the MIDAS files once
+        on one thread, once with a thread per subrun, and then the
+        trees of the merged ROOT file if one is given.  Every pass sums
+        all trace samples so the data is actually touched, the sums
+        should agree.
+
+usage:  bm_midas_read [--threads N] [--root run_N.root] <file.mid[.gz]> ...
+
+\*---------------------------------------------------------------------------*/
+
+//-- std includes ------------------------------------------------------------//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+//--- other includes ---------------------------------------------------------//
+#include "TFile.h"
+#include "TTree.h"
+
+//--- project includes -------------------------------------------------------//
+#include "common.hh"
+#include "util/root_output.hh"
+#include "offline/midas_file.hh"
+
+typedef decltype(daq::event_data::sis_3316_vec)::value_type sis_3316_board;
+typedef decltype(daq::event_data::sis_3302_vec)::value_type sis_3302_board;
+
+// Sum the samples of the digitizer banks of an event.
+unsigned long long SumTraces(const offline::Event& event)
+{
+  unsigned long long sum = 0;
+
+  event.ForEachBank([&](const offline::bank& b) {
+      if (strncmp(b.name, "16_", 3) == 0 || strncmp(b.name, "02_", 3) == 0) {
+        for (auto sample : b.as<uint16_t>()) {
+          sum += sample;
+        }
+      }
+
+      return true;
+    });
+
+  return sum;
+}
+
+void Report(const char *label, long long events, double bytes, double dt,
+            unsigned long long sum)
+{
+  printf("%-16s %10.1f events/s %9.1f MB/s  (%lld events, sum %llu)\n",
+         label, events / dt, bytes / dt * 1.0e-6, events, sum);
+}
+
+void ScanMidas(const std::vector<std::string>& files)
+{
+  offline::MidasFile file;
+  offline::Event event;
+  long long events = 0;
+  double bytes = 0.0;
+  unsigned long long sum = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  for (auto &path : files) {
+    if (!file.Open(path)) {
+      printf("%s\n", file.error().c_str());
+      exit(1);
+    }
+
+    while (file.Next(event)) {
+      sum += SumTraces(event);
+      ++events;
+    }
+
+    bytes += file.bytes_read();
+  }
+
+  auto t1 = std::chrono::steady_clock::now();
+  Report("midas 1 thread", events, bytes,
+         std::chrono::duration<double>(t1 - t0).count(), sum);
+}
+
+void ScanMidasParallel(const std::vector<std::string>& files, int num_threads)
+{
+  std::atomic<unsigned long long> sum(0);
+  std::atomic<unsigned long long> bytes(0);
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  long long events = offline::ForEachEvent(files, num_threads,
+    [&](int idx, const offline::Event& event) {
+      sum += SumTraces(event);
+      bytes += sizeof(offline::event_header) + event.header().data_size;
+    });
+
+  auto t1 = std::chrono::steady_clock::now();
+
+  char label[32];
+  sprintf(label, "midas %i threads", num_threads);
+  Report(label, events, bytes,
+         std::chrono::duration<double>(t1 - t0).count(), sum);
+}
+
+template <typename T>
+unsigned long long ScanTree(TTree *t, const char *fmt, double& bytes)
+{
+  static std::vector<T> boards(32);
+  unsigned long long sum = 0;
+  char name[64];
+  int num_boards = 0;
+
+  if (t == nullptr) return 0;
+
+  t->SetBranchStatus("*", 0);
+
+  sprintf(name, fmt, num_boards);
+  while (num_boards < (int)boards.size() &&
+         util::SetBoardAddress(t, name, boards[num_boards])) {
+    sprintf(name, fmt, ++num_boards);
+  }
+
+  for (Long64_t i = 0; i < t->GetEntries(); ++i) {
+    bytes += t->GetEntry(i);
+
+    for (int b = 0; b < num_boards; ++b) {
+      const WORD *p = &boards[b].trace[0][0];
+      const WORD *end = p + sizeof(boards[b].trace) / sizeof(WORD);
+
+      for (; p < end; ++p) {
+        sum += *p;
+      }
+    }
+  }
+
+  t->ResetBranchAddresses();
+
+  return sum;
+}
+
+void ScanRoot(const std::string& path)
+{
+  TFile *pf = new TFile(path.c_str());
+
+  if (pf->IsZombie()) {
+    printf("could not open %s\n", path.c_str());
+    exit(1);
+  }
+
+  TTree *t_sis3316 = (TTree *)pf->Get("t_sis3316");
+  TTree *t_sis3302 = (TTree *)pf->Get("t_sis3302");
+  double bytes = 0.0;
+  long long events = 0;
+  unsigned long long sum = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  if (t_sis3316 != nullptr) {
+    sum += ScanTree<sis_3316_board>(t_sis3316, "sis_3316_%i", bytes);
+    events = t_sis3316->GetEntries();
+  }
+
+  if (t_sis3302 != nullptr) {
+    sum += ScanTree<sis_3302_board>(t_sis3302, "sis_3302_%i", bytes);
+    events = std::max(events, t_sis3302->GetEntries());
+  }
+
+  auto t1 = std::chrono::steady_clock::now();
+  Report("root ttree", events, bytes,
+         std::chrono::duration<double>(t1 - t0).count(), sum);
+
+  pf->Close();
+  delete pf;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> files;
+  std::string root_file;
+  int num_threads = std::thread::hardware_concurrency();
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+
+    if (arg == "--threads" && i + 1 < argc) {
+      num_threads = atoi(argv[++i]);
+
+    } else if (arg == "--root" && i + 1 < argc) {
+      root_file = argv[++i];
+
+    } else {
+      files.push_back(arg);
+    }
+  }
+
+  if (files.empty()) {
+    printf("usage: %s [--threads N] [--root run_N.root] "
+           "<file.mid[.gz]> ...\n", argv[0]);
+    return 1;
+  }
+
+  ScanMidas(files);
+  ScanMidasParallel(files, num_threads);
+
+  if (!root_file.empty()) {
+    ScanRoot(root_file);
+  }
+
+  return 0;
+}
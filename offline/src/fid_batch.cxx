@@ -0,0 +1,332 @@
+/*---------------------------------------------------------------------------*\
+file:   fid_batch.cxx
+
+about:  Runs the fid::FID frequency extraction of the online monitor over
+        every channel of every event of a run and writes one entry per
+        trace to a small ROOT tree.
+
+          t_fid: serial/i time/i digitizer/b board/b channel/b
+                 freq/F snr/F chi2/F health/F
+
+        digitizer is 0 for the SIS3316 (16_N banks) and 1 for the
+        SIS3302 (02_N banks).  Zero-suppressed banks (Z16N and Z02N)
+        are decoded to the configured trace length first, banks that
+        are not 16-bit or hold no trace are skipped.  Traces are
+        gathered in batches and the fits of a batch are spread over a
+        pool of threads, each with its own buffers.  The tree is filled
+        from the main thread.  A file that ends on a corrupt or
+        truncated event fails the job.
+
+usage:  fid_batch [--threads N] [--batch N] [--dt seconds] [--out file]
+                  (--run N [--dir data_dir] | <file.mid[.gz]> ...)
+
+\*---------------------------------------------------------------------------*/
+
+//-- std includes ------------------------------------------------------------//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+//--- other includes ---------------------------------------------------------//
+#include <fftw3.h>
+#include "TFile.h"
+#include "TTree.h"
+
+//--- project includes -------------------------------------------------------//
+#include "fid.h"
+#include "common.hh"
+#include "util/convert.hh"
+#include "util/zero_suppress.hh"
+#include "offline/midas_file.hh"
+
+// One channel trace waiting for its fit.
+struct fid_job {
+  UInt_t serial;
+  UInt_t time;
+  UChar_t digitizer;
+  UChar_t board;
+  UChar_t channel;
+  size_t offset;  // into the batch samples
+  size_t length;
+};
+
+struct fid_result {
+  Float_t freq;
+  Float_t snr;
+  Float_t chi2;
+  Float_t health;
+};
+
+class FidBatch {
+ public:
+  FidBatch(int num_threads, size_t batch_size, double dt) :
+    num_threads_(num_threads), batch_size_(batch_size), dt_(dt) {};
+
+  // Queue the traces of an event, runs the batch once it is full.
+  void Add(const offline::Event& event, TTree *t) {
+    event.ForEachBank([&](const offline::bank& b) {
+        int digitizer, num_ch, zs_len;
+        bool sparse = (b.name[0] == 'Z');
+
+        if (strncmp(b.name, "16_", 3) == 0 ||
+            strncmp(b.name, "Z16", 3) == 0) {
+          digitizer = 0;
+          num_ch = SIS_3316_CH;
+          zs_len = SIS_3316_LN;
+
+        } else if (strncmp(b.name, "02_", 3) == 0 ||
+                   strncmp(b.name, "Z02", 3) == 0) {
+          digitizer = 1;
+          num_ch = SIS_3302_CH;
+          zs_len = SIS_3302_LN;
+
+        } else {
+          return true;
+        }
+
+        if (b.type != offline::kTidWord) {
+          ++num_skipped_;
+          return true;
+        }
+
+        auto trace = b.as<uint16_t>();
+
+        // Zero-suppressed traces, rebuild the dense version.
+        if (sparse) {
+          dense_.resize(num_ch * zs_len);
+
+          if (!util::ZeroSuppressDecode(trace.data(), trace.size(), num_ch,
+                                        zs_len, dense_.data())) {
+            ++num_skipped_;
+            return true;
+          }
+
+          trace = offline::Span<uint16_t>(dense_.data(), dense_.size());
+        }
+
+        size_t len = trace.size() / num_ch;
+
+        if (len == 0) {
+          ++num_skipped_;
+          return true;
+        }
+
+        for (int ch = 0; ch < num_ch; ++ch) {
+          fid_job job;
+          job.serial = event.serial();
+          job.time = event.time();
+          job.digitizer = digitizer;
+          job.board = atoi(b.name + 3);
+          job.channel = ch;
+          job.offset = samples_.size();
+          job.length = len;
+
+          auto wf = offline::Channel(trace, ch, len);
+          samples_.insert(samples_.end(), wf.begin(), wf.end());
+          jobs_.push_back(job);
+        }
+
+        return true;
+      });
+
+    if (jobs_.size() >= batch_size_) {
+      Run(t);
+    }
+  };
+
+  // Fit what is queued and fill the tree.
+  void Run(TTree *t) {
+    results_.resize(jobs_.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < num_threads_; ++i) {
+      threads.push_back(std::thread([this, &next] {
+            std::vector<double> wf, tm;
+            size_t idx;
+
+            while ((idx = next++) < jobs_.size()) {
+              Fit(jobs_[idx], results_[idx], wf, tm);
+            }
+          }));
+    }
+
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    for (size_t i = 0; i < jobs_.size(); ++i) {
+      job_ = jobs_[i];
+      result_ = results_[i];
+      t->Fill();
+    }
+
+    num_fits_ += jobs_.size();
+    jobs_.clear();
+    samples_.clear();
+  };
+
+  void Branch(TTree *t) {
+    t->Branch("serial", &job_.serial, "serial/i");
+    t->Branch("time", &job_.time, "time/i");
+    t->Branch("digitizer", &job_.digitizer, "digitizer/b");
+    t->Branch("board", &job_.board, "board/b");
+    t->Branch("channel", &job_.channel, "channel/b");
+    t->Branch("freq", &result_.freq, "freq/F");
+    t->Branch("snr", &result_.snr, "snr/F");
+    t->Branch("chi2", &result_.chi2, "chi2/F");
+    t->Branch("health", &result_.health, "health/F");
+  };
+
+  long long num_fits() const { return num_fits_; };
+  long long num_skipped() const { return num_skipped_; };
+
+ private:
+  int num_threads_;
+  size_t batch_size_;
+  double dt_;
+  long long num_fits_ = 0;
+  long long num_skipped_ = 0;
+
+  std::vector<uint16_t> dense_;  // a decoded zero-suppressed bank
+  std::vector<uint16_t> samples_;
+  std::vector<fid_job> jobs_;
+  std::vector<fid_result> results_;
+
+  // Branch buffers.
+  fid_job job_;
+  fid_result result_;
+
+  // wf and tm belong to the calling thread and are reused between fits.
+  void Fit(const fid_job& job, fid_result& res,
+           std::vector<double>& wf, std::vector<double>& tm) {
+    const uint16_t *p = &samples_[job.offset];
+
+    wf.resize(job.length);
+    util::WidenU16(p, job.length, wf.data());
+
+    if (tm.size() != job.length) {
+      tm.resize(job.length);
+      util::Ramp(job.length, 0.0, dt_, tm.data());
+    }
+
+    auto myfid = fid::FID(wf, tm);
+
+    res.freq = myfid.GetFreq();
+    res.snr = myfid.snr();
+    res.chi2 = myfid.chi2();
+    res.health = myfid.health();
+  };
+};
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> files;
+  std::string out_file;
+  std::string data_dir = ".";
+  int run = -1;
+  int num_threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+  size_t batch_size = 1 << 14;  // traces per batch
+  double dt = 0.0001;  // the sample period the online monitor assumes
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+
+    if (arg == "--threads" && i + 1 < argc) {
+      num_threads = std::max(atoi(argv[++i]), 1);
+
+    } else if (arg == "--batch" && i + 1 < argc) {
+      batch_size = std::max(atoi(argv[++i]), 1);
+
+    } else if (arg == "--dt" && i + 1 < argc) {
+      dt = atof(argv[++i]);
+
+    } else if (arg == "--out" && i + 1 < argc) {
+      out_file = argv[++i];
+
+    } else if (arg == "--run" && i + 1 < argc) {
+      run = atoi(argv[++i]);
+
+    } else if (arg == "--dir" && i + 1 < argc) {
+      data_dir = argv[++i];
+
+    } else {
+      files.push_back(arg);
+    }
+  }
+
+  if (run >= 0) {
+    files = offline::SubrunFiles(data_dir, run);
+  }
+
+  if (files.empty()) {
+    printf("usage: %s [--threads N] [--batch N] [--dt seconds] [--out file]"
+           " (--run N [--dir data_dir] | <file.mid[.gz]> ...)\n", argv[0]);
+    return 1;
+  }
+
+  if (out_file.empty()) {
+    char str[64];
+    sprintf(str, "fid_run_%05d.root", std::max(run, 0));
+    out_file = str;
+  }
+
+  // fid::FID plans its own transforms, so the FFTW planner has to be
+  // serialized for the threads to share it.
+  fftw_make_planner_thread_safe();
+
+  TFile *pf = new TFile(out_file.c_str(), "recreate");
+  TTree *t = new TTree("t_fid", "FID fits");
+  FidBatch batch(num_threads, batch_size, dt);
+  batch.Branch(t);
+
+  offline::MidasFile file;
+  offline::Event event;
+  long long num_events = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  for (auto &path : files) {
+    if (!file.Open(path)) {
+      printf("%s\n", file.error().c_str());
+      return 1;
+    }
+
+    while (file.Next(event)) {
+      batch.Add(event, t);
+      ++num_events;
+    }
+
+    // Next also stops at a corrupt or truncated event.
+    if (!file.error().empty()) {
+      printf("%s\n", file.error().c_str());
+      return 1;
+    }
+  }
+
+  batch.Run(t);
+
+  auto t1 = std::chrono::steady_clock::now();
+  double dt_run = std::chrono::duration<double>(t1 - t0).count();
+
+  pf->Write();
+  pf->Close();
+  delete pf;
+
+  printf("%lld events, %lld fits in %.1f s on %i threads, %.1f fits/s\n",
+         num_events, batch.num_fits(), dt_run, num_threads,
+         batch.num_fits() / dt_run);
+
+  if (batch.num_skipped() > 0) {
+    printf("%lld trace banks skipped, not 16-bit or malformed\n",
+           batch.num_skipped());
+  }
+
+  return 0;
+}
@@ -0,0 +1,382 @@
+#include "offline/midas_file.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace offline {
+
+namespace {
+
+struct bank16 {
+  char name[4];
+  uint16_t type;
+  uint16_t data_size;
+};
+
+struct bank32 {
+  char name[4];
+  uint32_t type;
+  uint32_t data_size;
+};
+
+struct bank32a {
+  char name[4];
+  uint32_t type;
+  uint32_t data_size;
+  uint32_t reserved;
+};
+
+inline size_t Align8(size_t size)
+{
+  return (size + 7) & ~(size_t)7;
+}
+
+bool EndsWith(const std::string& str, const std::string& suffix)
+{
+  return str.size() >= suffix.size() &&
+    str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // ::(anonymous)
+
+bool Event::has_banks() const
+{
+  return header_ != nullptr &&
+    header_->event_id != kEventIdBor &&
+    header_->event_id != kEventIdEor &&
+    header_->event_id != kEventIdMessage &&
+    header_->data_size >= sizeof(bank_header);
+}
+
+void Event::ForEachBank(const std::function<bool(const bank&)>& f) const
+{
+  if (!has_banks()) return;
+
+  auto pbh = (const bank_header *)(header_ + 1);
+  const char *p = (const char *)(pbh + 1);
+  const char *end = p + std::min<size_t>(pbh->data_size,
+                                         header_->data_size - sizeof(*pbh));
+
+  // Sizes are checked against the bytes left, a corrupt size can't
+  // move a pointer past the event.
+  while (p < end) {
+    size_t left = end - p;
+    size_t head;
+    size_t size;
+    bank b;
+
+    if (pbh->flags & kBankFormat64BitAligned) {
+      bank32a bk;
+      if (left < sizeof(bk)) return;
+      memcpy(&bk, p, sizeof(bk));
+      memcpy(b.name, bk.name, 4);
+      b.type = bk.type;
+      size = bk.data_size;
+      head = sizeof(bk);
+
+    } else if (pbh->flags & kBankFormat32Bit) {
+      bank32 bk;
+      if (left < sizeof(bk)) return;
+      memcpy(&bk, p, sizeof(bk));
+      memcpy(b.name, bk.name, 4);
+      b.type = bk.type;
+      size = bk.data_size;
+      head = sizeof(bk);
+
+    } else {
+      bank16 bk;
+      if (left < sizeof(bk)) return;
+      memcpy(&bk, p, sizeof(bk));
+      memcpy(b.name, bk.name, 4);
+      b.type = bk.type;
+      size = bk.data_size;
+      head = sizeof(bk);
+    }
+
+    // A bank running past the event means a corrupt event.
+    if (size > left - head) return;
+
+    b.name[4] = 0;
+    b.data = Span<char>(p + head, size);
+
+    if (!f(b)) return;
+
+    // The padding of the last bank may be cut off.
+    if (Align8(size) >= left - head) return;
+
+    p += head + Align8(size);
+  }
+}
+
+bool Event::FindBank(const char *name, bank& b) const
+{
+  bool found = false;
+
+  ForEachBank([&](const bank& bk) {
+      if (strncmp(bk.name, name, 4) == 0) {
+        b = bk;
+        found = true;
+      }
+
+      return !found;
+    });
+
+  return found;
+}
+
+std::vector<bank> Event::Banks() const
+{
+  std::vector<bank> banks;
+
+  ForEachBank([&](const bank& bk) {
+      banks.push_back(bk);
+      return true;
+    });
+
+  return banks;
+}
+
+Span<uint16_t> Event::Trace(const char *name) const
+{
+  bank b;
+
+  if (!FindBank(name, b) || b.type != kTidWord) {
+    return Span<uint16_t>();
+  }
+
+  return b.as<uint16_t>();
+}
+
+MidasFile::MidasFile() :
+  map_(nullptr), map_size_(0), offset_(0), gz_(nullptr), bytes_read_(0)
+{
+}
+
+MidasFile::~MidasFile()
+{
+  Close();
+}
+
+bool MidasFile::Open(const std::string& path)
+{
+  Close();
+  path_ = path;
+  error_.clear();
+
+  if (EndsWith(path, ".gz")) {
+    gz_ = gzopen(path.c_str(), "rb");
+
+    if (gz_ == nullptr) {
+      error_ = path + ": " + strerror(errno);
+      return false;
+    }
+
+    gzbuffer(gz_, 1 << 20);
+    return true;
+  }
+
+  int fd = open(path.c_str(), O_RDONLY);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    error_ = path + ": " + strerror(errno);
+    if (fd >= 0) close(fd);
+    return false;
+  }
+
+  map_size_ = st.st_size;
+
+  if (map_size_ > 0) {
+    void *p = mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (p == MAP_FAILED) {
+      error_ = path + ": " + strerror(errno);
+      close(fd);
+      return false;
+    }
+
+    madvise(p, map_size_, MADV_SEQUENTIAL);
+    map_ = (const char *)p;
+  }
+
+  // The mapping holds its own reference to the file.
+  close(fd);
+
+  return true;
+}
+
+void MidasFile::Close()
+{
+  if (map_ != nullptr) {
+    munmap((void *)map_, map_size_);
+    map_ = nullptr;
+  }
+
+  if (gz_ != nullptr) {
+    gzclose(gz_);
+    gz_ = nullptr;
+  }
+
+  map_size_ = 0;
+  offset_ = 0;
+  bytes_read_ = 0;
+}
+
+bool MidasFile::Next(Event& event, bool all)
+{
+  while (true) {
+    const event_header *header;
+
+    if (gz_ != nullptr) {
+      event_header h;
+
+      if (gzread(gz_, &h, sizeof(h)) != sizeof(h)) {
+        return false;
+      }
+
+      if (h.data_size > kMaxEventSize) {
+        error_ = path_ + ": corrupt event header";
+        return false;
+      }
+
+      buffer_.resize(sizeof(h) + h.data_size);
+      memcpy(buffer_.data(), &h, sizeof(h));
+
+      int size = h.data_size;
+      if (gzread(gz_, buffer_.data() + sizeof(h), size) != size) {
+        error_ = path_ + ": truncated event";
+        return false;
+      }
+
+      header = (const event_header *)buffer_.data();
+
+    } else {
+
+      if (offset_ + sizeof(event_header) > map_size_) {
+        return false;
+      }
+
+      header = (const event_header *)(map_ + offset_);
+
+      if (offset_ + sizeof(event_header) + header->data_size > map_size_) {
+        error_ = path_ + ": truncated event";
+        return false;
+      }
+
+      offset_ += sizeof(event_header) + header->data_size;
+    }
+
+    bytes_read_ += sizeof(event_header) + header->data_size;
+    event = Event(header);
+
+    if (all || event.has_banks()) {
+      return true;
+    }
+  }
+}
+
+void MidasFile::Rewind()
+{
+  if (gz_ != nullptr) {
+    gzrewind(gz_);
+  }
+
+  offset_ = 0;
+  bytes_read_ = 0;
+}
+
+std::vector<std::string> SubrunFiles(const std::string& dir, int run)
+{
+  std::vector<std::string> files;
+  char pattern[64];
+  glob_t matches;
+
+  sprintf(pattern, "run%05dsub*.mid*", run);
+  std::string path = dir;
+
+  if (path.size() > 0 && path[path.size() - 1] != '/') {
+    path += "/";
+  }
+
+  if (glob((path + pattern).c_str(), 0, NULL, &matches) == 0) {
+    for (size_t i = 0; i < matches.gl_pathc; ++i) {
+      files.push_back(std::string(matches.gl_pathv[i]));
+    }
+  }
+
+  globfree(&matches);
+
+  // A run without subruns is a single run%05d.mid file.
+  if (files.empty()) {
+    sprintf(pattern, "run%05d.mid*", run);
+
+    if (glob((path + pattern).c_str(), 0, NULL, &matches) == 0) {
+      files.push_back(std::string(matches.gl_pathv[0]));
+    }
+
+    globfree(&matches);
+  }
+
+  // glob sorts, and the subrun numbers are zero padded.
+  return files;
+}
+
+long long ForEachEvent(const std::vector<std::string>& files, int num_threads,
+                       const std::function<void(int, const Event&)>& f)
+{
+  std::atomic<int> next_file(0);
+  std::atomic<long long> num_events(0);
+  std::atomic<bool> failed(false);
+  std::vector<std::thread> threads;
+
+  num_threads = std::max(1, std::min<int>(num_threads, files.size()));
+
+  for (int i = 0; i < num_threads; ++i) {
+    threads.push_back(std::thread([&] {
+          MidasFile file;
+          Event event;
+          int idx;
+
+          while ((idx = next_file++) < (int)files.size()) {
+
+            if (!file.Open(files[idx])) {
+              fprintf(stderr, "%s\n", file.error().c_str());
+              failed = true;
+              continue;
+            }
+
+            long long count = 0;
+
+            while (file.Next(event)) {
+              f(idx, event);
+              ++count;
+            }
+
+            // Next also stops at a corrupt or truncated event.
+            if (!file.error().empty()) {
+              fprintf(stderr, "%s\n", file.error().c_str());
+              failed = true;
+            }
+
+            num_events += count;
+          }
+        }));
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  return failed ? -1 : num_events.load();
+}
+
+} // ::offline
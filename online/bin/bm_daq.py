@@ -0,0 +1,370 @@
+#!/usr/bin/env python3
+"""
+file:   bm_daq.py
+
+about:  End-to-end throughput benchmark for the DAQ chain.  It brings up
+        a private MIDAS experiment in a scratch directory, runs the SIS
+        frontends against simulated digitizers together with
+        an_online_monitor, and records for every stage the events/s,
+        MB/s, CPU% and dropped events plus the SYSTEM buffer fill level.
+        The board count and trace length are swept and the results are
+        written as JSON, sorted so two reports diff cleanly.
+
+usage:  bm_daq.py [--boards 1,2,4] [--trace-lengths 0,4096,16384]
+                  [--rate 0] [--duration 30] [--combined]
+                  [--out bm_daq.json]
+        bm_daq.py --compare old.json new.json
+
+        A trace length of 0 means full records.  Shorter ones only pad
+        the record with baseline, so they turn on zero-suppression to
+        actually shrink the data, see sim_event_manager.hh.
+
+        With --combined both families are read out by fe_sis33xx in one
+        process instead of by fe_sis3316 and fe_sis3302.
+"""
+
+import argparse
+import getpass
+import json
+import os
+import platform
+import re
+import shutil
+import signal
+import subprocess
+import sys
+import time
+
+EXPT = 'bm-daq'
+FRONTENDS = ['fe_sis3316', 'fe_sis3302']
+FAMILIES = {
+    'fe_sis3316': ['sis_3316'],
+    'fe_sis3302': ['sis_3302'],
+    'fe_sis33xx': ['sis_3316', 'sis_3302'],
+}
+ANALYZERS = ['an_online_monitor']
+
+REPO_DIR = os.path.abspath(os.path.join(os.path.dirname(__file__), '..', '..'))
+CLK_TCK = os.sysconf('SC_CLK_TCK')
+
+
+def odb(cmd):
+    """Run one odbedit command against the private experiment."""
+    out = subprocess.run(['odbedit', '-e', EXPT, '-c', cmd],
+                         stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                         universal_newlines=True)
+    return out.stdout
+
+
+def odb_set(path, typestring, value):
+    odb('create %s "%s"' % (typestring, path))
+    odb('set "%s" "%s"' % (path, value))
+
+
+def odb_ls(path):
+    """Read the numeric keys of one ODB directory as a dict."""
+    values = {}
+
+    for line in odb('ls "%s"' % path).splitlines():
+        fields = re.split(r'\s{2,}', line.strip(), maxsplit=1)
+
+        if len(fields) != 2:
+            continue
+
+        try:
+            values[fields[0]] = float(fields[1])
+        except ValueError:
+            pass
+
+    return values
+
+
+def cpu_ticks(pid):
+    """User plus system time of a process in clock ticks."""
+    try:
+        with open('/proc/%i/stat' % pid) as f:
+            fields = f.read().rsplit(')', 1)[1].split()
+        return int(fields[11]) + int(fields[12])
+    except (IOError, IndexError):
+        return 0
+
+
+def setup_experiment(workdir):
+    """Create the exptab, ODB and directories of the private experiment."""
+    if os.path.exists(workdir):
+        shutil.rmtree(workdir)
+
+    os.makedirs(os.path.join(workdir, 'data'))
+    os.makedirs(os.path.join(workdir, 'config'))
+
+    exptab = os.path.join(workdir, 'exptab')
+    with open(exptab, 'w') as f:
+        f.write('%s %s %s\n' % (EXPT, workdir, getpass.getuser()))
+
+    os.environ['MIDAS_EXPTAB'] = exptab
+    os.environ['MIDAS_EXPT_NAME'] = EXPT
+
+    if shutil.which('odbinit'):
+        subprocess.call(['odbinit', '-e', EXPT, '--cleanup'],
+                        stdout=subprocess.DEVNULL)
+
+    odb_set('/Logger/Data dir', 'STRING', os.path.join(workdir, 'data'))
+    odb_set('/Logger/History dir', 'STRING', workdir)
+    odb_set('/Logger/Log Dir', 'STRING', workdir)
+    odb_set('/Params/config-dir', 'STRING', os.path.join(workdir, 'config'))
+    odb_set('/Params/root-output', 'BOOL', 'y')
+    odb_set('/Params/midas-output', 'BOOL', 'y')
+
+    for fe in FRONTENDS:
+        name = fe.replace('_', '-')
+        odb_set('/Params/config-file/%s' % name, 'STRING', fe + '.json')
+
+
+def write_configs(workdir, boards, trace_length, args):
+    """Simulated crate configs for one sweep point."""
+    confdir = os.path.join(workdir, 'config')
+
+    for fe in FRONTENDS:
+        devices = {}
+
+        for family in FAMILIES[fe]:
+            devices[family] = {}
+
+            for i in range(boards):
+                name = '%s_%i' % (family, i)
+                devices[family][name] = 'sim_%s.json' % name
+
+                with open(os.path.join(confdir, devices[family][name]),
+                          'w') as f:
+                    f.write('{}\n')
+
+        conf = {
+            'devices': devices,
+            'simulation': {
+                'enabled': True,
+                'rate': args.rate,
+                'poisson': args.rate > 0,
+                'canned_events': 16,
+                'queue_depth': 64,
+                'trace_length': trace_length,
+            },
+        }
+
+        with open(os.path.join(confdir, fe + '.json'), 'w') as f:
+            json.dump(conf, f, indent=4)
+
+        # fe_sis33xx follows the keys of the single family frontends.
+        zs = 'y' if trace_length > 0 else 'n'
+        for family in FAMILIES[fe]:
+            odb_set('/Params/zero-suppression/fe-%s/enabled' %
+                    family.replace('_', ''), 'BOOL', zs)
+
+
+def start_clients(bindir, workdir):
+    procs = {}
+
+    for client in FRONTENDS + ANALYZERS:
+        log = open(os.path.join(workdir, client + '.log'), 'a')
+        procs[client] = subprocess.Popen([os.path.join(bindir, client),
+                                          '-e', EXPT],
+                                         stdout=log, stderr=log)
+
+    # Give the clients time to connect and book their buffers.
+    time.sleep(5)
+
+    for client, p in procs.items():
+        if p.poll() is not None:
+            stop_clients(procs)
+            sys.exit('%s exited at startup, see %s/%s.log' %
+                     (client, workdir, client))
+
+    return procs
+
+
+def stop_clients(procs):
+    for p in procs.values():
+        if p.poll() is None:
+            p.send_signal(signal.SIGINT)
+
+    for p in procs.values():
+        try:
+            p.wait(timeout=10)
+        except subprocess.TimeoutExpired:
+            p.kill()
+
+
+def run_point(bindir, workdir, boards, trace_length, args):
+    """Take one run and return the per-stage numbers."""
+    write_configs(workdir, boards, trace_length, args)
+    procs = start_clients(bindir, workdir)
+    pids = dict((name.replace('_', '-'), p.pid) for name, p in procs.items())
+    pids['online-monitor'] = pids.pop('an-online-monitor')
+
+    buffer_size = odb_ls('/Experiment/Buffer sizes').get('SYSTEM', 0)
+    levels = []
+    rates = dict((fe.replace('_', '-'), []) for fe in FRONTENDS)
+
+    odb('start now')
+    t0 = time.time()
+    ticks0 = dict((name, cpu_ticks(pid)) for name, pid in pids.items())
+    mon0 = odb_ls('/Equipment/online-monitor/Metrics')
+
+    while time.time() - t0 < args.duration:
+        time.sleep(1.0)
+
+        metrics = odb_ls('/Equipment/online-monitor/Metrics')
+        levels.append(metrics.get('buffer-level-bytes', 0))
+
+        for fe in rates:
+            stats = odb_ls('/Equipment/%s/Statistics' % fe)
+            rates[fe].append(stats.get('kBytes per sec.', 0) * 1.0e-3)
+
+    dt = time.time() - t0
+    ticks1 = dict((name, cpu_ticks(pid)) for name, pid in pids.items())
+    mon1 = odb_ls('/Equipment/online-monitor/Metrics')
+
+    odb('stop now')
+    time.sleep(2)
+
+    stages = {}
+
+    for name in pids:
+        stage = {'cpu_percent': 100.0 * (ticks1[name] - ticks0[name]) /
+                 CLK_TCK / dt}
+
+        if name in rates:
+            stats = odb_ls('/Equipment/%s/Statistics' % name)
+            metrics = odb_ls('/Equipment/%s/Metrics' % name)
+            stage['events'] = stats.get('Events sent', 0)
+            stage['events_per_sec'] = stage['events'] / dt
+            stage['mb_per_sec'] = sum(rates[name]) / max(len(rates[name]), 1)
+            stage['dropped_events'] = metrics.get('dropped-events', 0)
+            stage['jitter_p99_us'] = metrics.get('jitter-p99-us', 0)
+            stage['poll_detect_p99_us'] = metrics.get('poll-detect-p99-us', 0)
+            stage['poll_busy_fraction'] = metrics.get('poll-busy-fraction', 0)
+
+        else:
+            events = (mon1.get('events-received', 0) -
+                      mon0.get('events-received', 0))
+            mb = mon1.get('mb-received', 0) - mon0.get('mb-received', 0)
+            stage['events'] = events
+            stage['events_per_sec'] = events / dt
+            stage['mb_per_sec'] = mb / dt
+
+        stages[name] = stage
+
+    # Events the analyzer skipped are dropped too, GET_NONBLOCKING.
+    sent = min(stages[fe.replace('_', '-')]['events'] for fe in FRONTENDS)
+    stages['online-monitor']['dropped_events'] = max(
+        sent - stages['online-monitor']['events'], 0)
+
+    stages['buffer'] = {
+        'size_bytes': buffer_size,
+        'mean_level_bytes': sum(levels) / max(len(levels), 1),
+        'max_level_bytes': max(levels) if levels else 0,
+        'max_fill': max(levels) / buffer_size if buffer_size and levels else 0,
+    }
+
+    stop_clients(procs)
+
+    # Don't let the data pile up between points.
+    datadir = os.path.join(workdir, 'data')
+    for name in os.listdir(datadir):
+        os.remove(os.path.join(datadir, name))
+
+    return {'boards': boards, 'trace_length': trace_length,
+            'duration': dt, 'stages': stages}
+
+
+def compare(old_file, new_file):
+    """Print the relative change of every number between two reports."""
+    with open(old_file) as f:
+        old = json.load(f)
+
+    with open(new_file) as f:
+        new = json.load(f)
+
+    key = lambda p: (p['boards'], p['trace_length'])
+    old_points = dict((key(p), p) for p in old['points'])
+
+    for point in new['points']:
+        if key(point) not in old_points:
+            continue
+
+        print('boards %i, trace length %i' % key(point))
+        before = old_points[key(point)]['stages']
+
+        for stage, values in sorted(point['stages'].items()):
+            for name, val in sorted(values.items()):
+                prev = before.get(stage, {}).get(name)
+
+                if prev is None:
+                    continue
+
+                change = 100.0 * (val - prev) / prev if prev else 0.0
+                print('  %-16s %-18s %12.2f %12.2f %+8.1f%%' %
+                      (stage, name, prev, val, change))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='DAQ throughput benchmark')
+    parser.add_argument('--boards', default='1,2,4')
+    parser.add_argument('--trace-lengths', default='0')
+    parser.add_argument('--rate', type=float, default=0.0,
+                        help='triggers per second, 0 is as fast as possible')
+    parser.add_argument('--duration', type=float, default=30.0)
+    parser.add_argument('--combined', action='store_true',
+                        help='read both families out with fe_sis33xx')
+    parser.add_argument('--bin-dir',
+                        default=os.path.join(REPO_DIR, 'online', 'frontends',
+                                             'bin'))
+    parser.add_argument('--workdir', default='/tmp/bm_daq')
+    parser.add_argument('--out', default='bm_daq.json')
+    parser.add_argument('--compare', nargs=2, metavar=('OLD', 'NEW'))
+    args = parser.parse_args()
+
+    if args.compare:
+        compare(*args.compare)
+        return
+
+    if args.combined:
+        FRONTENDS[:] = ['fe_sis33xx']
+
+    setup_experiment(args.workdir)
+
+    try:
+        version = subprocess.check_output(
+            ['git', '-C', REPO_DIR, 'describe', '--always', '--dirty'],
+            universal_newlines=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        version = 'unknown'
+
+    report = {
+        'version': version,
+        'host': platform.node(),
+        'cpus': os.cpu_count(),
+        'date': time.strftime('%Y-%m-%dT%H:%M:%S'),
+        'rate': args.rate,
+        'frontends': FRONTENDS,
+        'points': [],
+    }
+
+    for boards in [int(b) for b in args.boards.split(',')]:
+        for length in [int(l) for l in args.trace_lengths.split(',')]:
+            print('boards %i, trace length %i' % (boards, length))
+            point = run_point(args.bin_dir, args.workdir, boards, length, args)
+            report['points'].append(point)
+
+            for stage, values in sorted(point['stages'].items()):
+                if 'events_per_sec' in values:
+                    print('  %-16s %10.1f events/s %8.1f MB/s %6.1f%% cpu' %
+                          (stage, values['events_per_sec'],
+                           values['mb_per_sec'], values['cpu_percent']))
+
+    with open(args.out, 'w') as f:
+        json.dump(report, f, indent=2, sort_keys=True)
+        f.write('\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -10,27 +10,34 @@ for addr in $EXT_IP; do
     addresslist="$addresslist -a $addr"
 done
 
+# Keep the MIDAS utilities off the cores reserved for readout.
+pin=""
+if [ -n "$MIDAS_CPUS" ]; then
+    pin="taskset -c $MIDAS_CPUS "
+fi
+
 # Restart the daq components for the basic_vme setup.
 for mu in "${MIDAS_UTIL[@]}"; do
 
     case $mu in
         'mserver')
-        cmd="mserver $addresslist -p $MSERVER_PORT$(printf \\r)"
+        cmd="${pin}mserver $addresslist -p $MSERVER_PORT$(printf \\r)"
         screen -dmS "${EXPT}.mserver"
         screen -S "${EXPT}.mserver" -p 0 -rX stuff "$cmd";;
     
         'mhttpd')
-        cmd="mhttpd  -e $EXPT $addresslist --mg $MHTTPD_PORT$(printf \\r)"
+        cmd="${pin}mhttpd  -e $EXPT $addresslist --mg $MHTTPD_PORT$(printf \\r)"
         screen -dmS "${EXPT}.mhttpd"
         screen -S "${EXPT}.mhttpd" -p 0 -rX stuff "$cmd";;
     
         'mlogger')
-        cmd="mlogger -e $EXPT$(printf \\r)"
+        cmd="${pin}mlogger -e $EXPT$(printf \\r)"
         screen -dmS "${EXPT}.mlogger"
         screen -S "${EXPT}.mlogger" -p 0 -rX stuff "$cmd";;
     esac
 done
 
 unset cmd
+unset pin
 unset addresslist
 # end script
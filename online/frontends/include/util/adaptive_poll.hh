@@ -0,0 +1,83 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_ADAPTIVE_POLL_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_ADAPTIVE_POLL_HH_
+
+/*===========================================================================*\
+
+file:   adaptive_poll.hh
+
+about:  Polling for poll_event that spins right after an event, backs
+        off with doubling sleeps once none comes, and parks with long
+        sleeps after a quiet spell.  The backoff is capped at a fraction
+        of the average time between events, so the detection delay
+        follows the event rate.  It keeps the gap between the last
+        empty check and the one that saw the event, an upper bound on
+        how long an event waited to be seen.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <chrono>
+#include <functional>
+
+//--- project includes ------------------------------------------------------//
+#include "util/realtime.hh"
+
+namespace util {
+
+struct poll_policy {
+  bool adaptive = true;          // false checks once per call, as before
+  double spin_us = 50.0;         // spin this long after an event
+  double min_sleep_us = 10.0;    // the first backoff sleep
+  double max_sleep_us = 1000.0;  // the longest backoff sleep
+  double park_after_ms = 200.0;  // quiet time before parking
+  double park_us = 5000.0;       // the sleep while parked
+  double window_ms = 25.0;       // the longest one Wait takes
+};
+
+class AdaptivePoller {
+ public:
+  AdaptivePoller();
+
+  void set_policy(const poll_policy& policy);
+  const poll_policy& policy() const { return policy_; };
+
+  // Clear the counters, at the start of a run.
+  void Reset();
+
+  // Check has_event until it reports an event or the window is over.
+  bool Wait(const std::function<bool()>& has_event);
+
+  // Average time between events, exponentially weighted.
+  double mean_interval_us() const { return mean_interval_us_; };
+
+  // Time spent checking over time spent in Wait.
+  double busy_fraction() const;
+
+  unsigned long long parks() const { return parks_; };
+  const JitterMonitor& detect() const { return detect_; };
+
+  // One line summary suitable for cm_msg.
+  std::string Report() const;
+
+ private:
+  typedef std::chrono::steady_clock clock;
+
+  poll_policy policy_;
+  JitterMonitor detect_;
+
+  clock::time_point last_event_;
+  clock::time_point last_miss_;
+  bool have_event_;
+  bool have_miss_;
+  double mean_interval_us_;
+  double sleep_us_;
+
+  double busy_us_;
+  double idle_us_;
+  unsigned long long parks_;
+};
+
+} // ::util
+
+#endif
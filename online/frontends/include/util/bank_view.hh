@@ -0,0 +1,85 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_BANK_VIEW_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_BANK_VIEW_HH_
+
+/*===========================================================================*\
+
+file:   bank_view.hh
+
+about:  Digitizer banks seen as num_ch traces of equal length, with the
+        length taken from the bank size rather than assumed.  A bank
+        that doesn't split evenly, or has the wrong type, gives an
+        invalid view, so malformed data is turned away with a size
+        check.  Nothing is copied, a view is only good while the event
+        it points into is.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+namespace util {
+
+template <typename T>
+class TraceView {
+ public:
+  TraceView() : data_(nullptr), num_ch_(0), len_(0) {};
+
+  // Invalid unless size is a positive multiple of num_ch.
+  TraceView(const T *data, size_t size, int num_ch) : TraceView() {
+    if (data != nullptr && num_ch > 0 && size > 0 && size % num_ch == 0) {
+      data_ = data;
+      num_ch_ = num_ch;
+      len_ = size / num_ch;
+    }
+  };
+
+  bool valid() const { return data_ != nullptr; };
+  explicit operator bool() const { return valid(); };
+
+  int num_ch() const { return num_ch_; };
+  int len() const { return len_; };
+  size_t size() const { return (size_t)num_ch_ * len_; };
+  const T *data() const { return data_; };
+
+  // The samples of a channel, nullptr if there is no such channel.
+  const T *trace(int ch) const {
+    if (ch < 0 || ch >= num_ch_) return nullptr;
+    return data_ + (size_t)ch * len_;
+  };
+
+  // A checked sample, std::out_of_range like std::vector::at.
+  T at(int ch, int idx) const {
+    if (ch < 0 || ch >= num_ch_ || idx < 0 || idx >= len_) {
+      throw std::out_of_range("util::TraceView::at");
+    }
+
+    return data_[(size_t)ch * len_ + idx];
+  };
+
+  // Copy the traces back to back into dst, false if more than
+  // capacity samples would be needed.
+  bool CopyTo(T *dst, size_t capacity) const {
+    if (!valid() || size() > capacity) return false;
+
+    std::copy(data_, data_ + size(), dst);
+    return true;
+  };
+
+ private:
+  const T *data_;
+  int num_ch_;
+  int len_;
+};
+
+// The named TID_WORD bank of a MIDAS event as num_ch traces.  The view
+// is invalid if the bank is missing, and rejected is set if it is there
+// but has the wrong type or size.
+TraceView<uint16_t> LocateTraces(void *pevent, const char *name, int num_ch,
+                                 bool *rejected=nullptr);
+
+} // ::util
+
+#endif
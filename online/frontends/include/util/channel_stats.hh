@@ -0,0 +1,79 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_CHANNEL_STATS_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_CHANNEL_STATS_HH_
+
+/*===========================================================================*\
+
+file:   channel_stats.hh
+
+about:  Per-channel baseline, noise, extremes and hit rate of a digitizer
+        over an interval.  Each event's baseline window is reduced to a
+        mean and a sum of squares and merged into the channel's running
+        Welford sums, so an event costs the same however many came
+        before it.  Take hands over the interval and starts the next.
+        Any number of threads may fill.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+
+namespace util {
+
+// Welford's running mean and variance, with Chan's merge of two sets.
+struct running_stats {
+  long long n = 0;
+  double mean = 0.0;
+  double m2 = 0.0;  // sum of squared deviations from the mean
+
+  void Add(double x);
+  void Merge(long long n_b, double mean_b, double m2_b);
+  double rms() const;
+};
+
+struct channel_summary {
+  double baseline;  // mean of the baseline samples
+  double rms;       // their spread, the noise
+  double min;       // over the whole traces
+  double max;
+  double rate;      // traces over threshold per second
+};
+
+class ChannelStats {
+ public:
+  // The first baseline_len samples of each trace are the baseline, a
+  // trace with a sample threshold above it counts as a hit.
+  ChannelStats(int num_ch, int trace_len, int baseline_len=64,
+               double threshold=100.0);
+
+  void set_threshold(double threshold);
+
+  // Add an event, num_ch traces of trace_len samples back to back.
+  void Fill(const uint16_t *traces);
+
+  // The interval so far, one summary per channel, and the events per
+  // second.  Clears the sums for the next interval.
+  void Take(std::vector<channel_summary>& channels, double& event_rate);
+
+ private:
+  int num_ch_;
+  int trace_len_;
+  int baseline_len_;
+
+  std::mutex mutex_;
+  double threshold_;
+  long long num_events_;
+  std::vector<running_stats> baseline_;
+  std::vector<uint16_t> min_;
+  std::vector<uint16_t> max_;
+  std::vector<long long> hits_;
+  std::chrono::steady_clock::time_point start_;
+
+  void Clear();
+};
+
+} // ::util
+
+#endif
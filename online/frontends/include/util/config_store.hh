@@ -0,0 +1,80 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_CONFIG_STORE_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_CONFIG_STORE_HH_
+
+/*===========================================================================*\
+
+file:   config_store.hh
+
+about:  A content-addressed store for the JSON configs.  Every config
+        file is kept once under its hash, <store>/<hash>.json, and a run
+        is archived as a small manifest naming the files it used.
+
+          {
+            "fe_sis3316": { "file": "fnal/fe_sis3316.json",
+                            "hash": "9c1e0a6b1f3d2e47" },
+            "sis_3316_0": { "file": "fnal/sis_3316_0.json", ... }
+          }
+
+        Files are only rehashed when their size or mtime changes, so an
+        unchanged setup costs a stat per file at the end of a run.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+//--- other includes --------------------------------------------------------//
+#include "boost/property_tree/ptree.hpp"
+
+namespace util {
+
+// FNV-1a 64 of a buffer, as 16 hex digits.
+std::string ContentHash(const std::string& data);
+
+class ConfigStore {
+ public:
+  ConfigStore(const std::string& store_dir);
+
+  // Add a top-level config and the json files it refers to under
+  // "devices" and at the first level to a run manifest.
+  void Archive(const std::string& name, const std::string& conf_dir,
+               const std::string& file, boost::property_tree::ptree &manifest);
+
+  // Store one file if its content is new and return the hash, empty if
+  // the file could not be read.
+  std::string Add(const std::string& path);
+
+  // Read back a stored config.
+  bool Load(const std::string& hash, boost::property_tree::ptree &conf);
+
+  std::string BlobPath(const std::string& hash) const {
+    return store_dir_ + hash + ".json";
+  };
+
+ private:
+  typedef std::vector<std::pair<std::string, std::string>> ref_list;
+
+  struct entry {
+    long long mtime_ns;
+    long long size;
+    std::string hash;
+    bool refs_parsed;
+    ref_list refs;
+  };
+
+  std::string store_dir_;
+  std::map<std::string, entry> cache_;
+
+  entry *Lookup(const std::string& path);
+  const ref_list &References(const std::string& path);
+  void AddToManifest(const std::string& name, const std::string& conf_dir,
+                     const std::string& file,
+                     boost::property_tree::ptree &manifest);
+};
+
+} // ::util
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_CONVERT_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_CONVERT_HH_
+
+/*===========================================================================*\
+
+file:   convert.hh
+
+about:  Sample conversion kernels, 16-bit digitizer and scope samples
+        to double with an optional scale and offset.  There is an AVX2
+        version of each, picked at run time when the CPU has it, and a
+        scalar one for everything else.  The results are identical.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace util {
+
+// dst[i] = src[i]
+void WidenU16(const uint16_t *src, size_t n, double *dst);
+
+// dst[i] = src[i] * scale + offset
+void ScaleU16(const uint16_t *src, size_t n, double scale, double offset,
+              double *dst);
+
+// Signed 16-bit samples from raw bytes, as scopes send them, least
+// significant byte first unless big_endian.  dst[i] = x * scale + offset
+void ScaleI16Bytes(const char *src, size_t n, bool big_endian, double scale,
+                   double offset, double *dst);
+
+// dst[i] = offset + i * step, for time axes.
+void Ramp(size_t n, double offset, double step, double *dst);
+
+// The kernels in use, "avx2" or "scalar".
+const char *ConvertIsa();
+
+// Force "scalar" or "avx2", false if the CPU can't run it.  For
+// benchmarks and comparisons.
+bool SetConvertIsa(const std::string& isa);
+
+} // ::util
+
+#endif
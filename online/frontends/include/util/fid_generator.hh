@@ -0,0 +1,49 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_FID_GENERATOR_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_FID_GENERATOR_HH_
+
+/*===========================================================================*\
+
+file:   fid_generator.hh
+
+about:  Generates realistic digitizer traces, a decaying NMR free
+        induction decay on top of a baseline with gaussian noise.  It
+        is used for canned benchmark data and simulated digitizers.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <random>
+
+namespace util {
+
+struct fid_config {
+  double sample_rate;   // Hz
+  double frequency;     // Hz, the mixed down FID frequency
+  double t2;            // s, decay time of the envelope
+  double amplitude;     // ADC counts at the start of the FID
+  double baseline;      // ADC counts
+  double noise;         // ADC counts rms
+  double start;         // s, FID start relative to the first sample
+  double max_adc;       // clipping value, 16383 for 14-bit boards
+};
+
+// Defaults close to what the NMR probes give on a SIS3316.
+fid_config DefaultFidConfig();
+
+class FidGenerator {
+ public:
+  FidGenerator(unsigned int seed=42);
+
+  // Fill one trace of len samples with a fresh FID, the amplitude and
+  // phase get a small random jitter from trace to trace.
+  void Fill(unsigned short *trace, int len, const fid_config &conf);
+
+ private:
+  std::mt19937 rng_;
+  std::normal_distribution<double> gaus_;
+  std::uniform_real_distribution<double> flat_;
+};
+
+} // ::util
+
+#endif
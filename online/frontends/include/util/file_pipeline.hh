@@ -0,0 +1,49 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_FILE_PIPELINE_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_FILE_PIPELINE_HH_
+
+/*===========================================================================*\
+
+file:   file_pipeline.hh
+
+about:  File handling after a run is merged: CRC-32 checksums, removal
+        of the frontend files and hand-off to archival storage.  All of
+        it uses system calls directly, nothing goes through a shell.
+
+        Archiving either hard-links the file into the archive directory
+        or moves it there.  A move across filesystems is a copy that is
+        checksummed before the original is removed.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <vector>
+
+namespace util {
+
+enum archive_mode {
+  kArchiveNone,
+  kArchiveLink,
+  kArchiveMove
+};
+
+// Parse /Params/run-jobs/archive-mode, "link", "move" or "none".
+archive_mode ParseArchiveMode(const std::string& mode);
+
+// CRC-32 of a file as zlib computes it, false if it can't be read.
+bool FileCrc32(const std::string& path, unsigned long& crc);
+
+// Write a "<crc>  <name>" line next to the file, as <path>.crc32.
+bool WriteCrc32File(const std::string& path, unsigned long crc);
+
+// Unlink the files, on failure error names the ones left.
+bool RemoveFiles(const std::vector<std::string>& paths, std::string& error);
+
+// Link or move a file into dir, never replacing a file already there.
+// Returns the archived path or an empty string and the reason in error.
+std::string ArchiveFile(const std::string& path, const std::string& dir,
+                        archive_mode mode, std::string& error);
+
+} // ::util
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_MPMC_QUEUE_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_MPMC_QUEUE_HH_
+
+/*===========================================================================*\
+
+file:   mpmc_queue.hh
+
+about:  Bounded lock-free queue for any number of producers and
+        consumers, Dmitry Vyukov's design.  Each cell carries a sequence
+        number that tells a producer or consumer whether it is its turn,
+        so a push or pop is one compare-and-swap on the shared index and
+        never blocks.  A full or empty queue just returns false.
+
+        BlockingMpmcQueue adds waiting on top for threads that would
+        rather sleep than spin.  Push and pop stay lock-free while there
+        is room or an element, the lock is only taken to wait, and to
+        wake someone who waits.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+namespace util {
+
+template <typename T>
+class MpmcQueue {
+ public:
+  // The capacity is rounded up to a power of two.
+  explicit MpmcQueue(size_t capacity) {
+    size_t size = 2;
+
+    while (size < capacity) {
+      size <<= 1;
+    }
+
+    mask_ = size - 1;
+    cells_.reset(new cell[size]);
+
+    for (size_t i = 0; i < size; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+  };
+
+  // False if the queue is full.
+  bool TryPush(const T& value) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    cell *c;
+
+    while (true) {
+      c = &cells_[pos & mask_];
+      size_t seq = c->seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+
+      } else if (diff < 0) {
+        return false;
+
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+
+    c->value = value;
+    c->seq.store(pos + 1, std::memory_order_release);
+
+    return true;
+  };
+
+  // False if the queue is empty.
+  bool TryPop(T& value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    cell *c;
+
+    while (true) {
+      c = &cells_[pos & mask_];
+      size_t seq = c->seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+
+      } else if (diff < 0) {
+        return false;
+
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+
+    value = c->value;
+    c->seq.store(pos + mask_ + 1, std::memory_order_release);
+
+    return true;
+  };
+
+  size_t capacity() const { return mask_ + 1; };
+
+  // Only a snapshot while others push and pop.
+  size_t size() const {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    return (head > tail) ? head - tail : 0;
+  };
+
+ private:
+  struct cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  std::unique_ptr<cell[]> cells_;
+  size_t mask_;
+
+  // Producers and consumers each get their own cache line.
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+};
+
+template <typename T>
+class BlockingMpmcQueue {
+ public:
+  explicit BlockingMpmcQueue(size_t capacity) :
+    queue_(capacity), waiting_(0), closed_(false) {};
+
+  // False if the queue is full.
+  bool TryPush(const T& value) {
+    return Done(queue_.TryPush(value));
+  };
+
+  // False if the queue is empty.
+  bool TryPop(T& value) {
+    return Done(queue_.TryPop(value));
+  };
+
+  // Waits while the queue is full, false if it was closed meanwhile.
+  bool Push(const T& value) {
+    return Wait([&] { return queue_.TryPush(value); });
+  };
+
+  // Waits while the queue is empty, false once it is closed and empty.
+  bool Pop(T& value) {
+    return Wait([&] { return queue_.TryPop(value); });
+  };
+
+  // Wake everyone waiting, Push and Pop no longer wait afterwards.
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    changed_.notify_all();
+  };
+
+  size_t capacity() const { return queue_.capacity(); };
+  size_t size() const { return queue_.size(); };
+
+ private:
+  MpmcQueue<T> queue_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::atomic<int> waiting_;
+  bool closed_;
+
+  // After a push or pop, someone may wait for it.  The fence pairs with
+  // the one in Wait, either the waiter sees the change or we see it.
+  bool Done(bool changed) {
+    if (changed) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      if (waiting_.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        changed_.notify_all();
+      }
+    }
+
+    return changed;
+  };
+
+  template <typename F>
+  bool Wait(F attempt) {
+    if (attempt()) {
+      return Done(true);
+    }
+
+    bool ok = false;
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    ++waiting_;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    changed_.wait(lock, [&] { return (ok = attempt()) || closed_; });
+
+    --waiting_;
+    lock.unlock();
+
+    return Done(ok);
+  };
+};
+
+} // ::util
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_PARAM_CACHE_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_PARAM_CACHE_HH_
+
+/*===========================================================================*\
+
+file:   param_cache.hh
+
+about:  Typed, hot-linked copies of ODB keys.  The first read of a key
+        finds it, creating it with the default if missing, and opens a
+        record on it.  Later reads come from the cache, which MIDAS
+        updates when the key changes, so run transitions don't walk the
+        ODB and strings are not limited to a fixed buffer.
+
+        Reads are thread safe, the hot-links are served by the thread
+        calling cm_yield.  A key rewritten at a different size, such as
+        a longer string, no longer fits its record and is linked again
+        on the next read.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+//--- other includes --------------------------------------------------------//
+#include "midas.h"
+
+namespace util {
+
+class ParamCache {
+ public:
+  ParamCache();
+  ~ParamCache();
+
+  std::string String(const std::string& key, const std::string& def="");
+  double Double(const std::string& key, double def=0.0);
+  int Int(const std::string& key, int def=0);
+  bool Bool(const std::string& key, bool def=false);
+
+  // A directory with a trailing separator, empty if unset.
+  std::string Dir(const std::string& key, const std::string& def="");
+
+  // Call back from the thread serving the hot-links whenever the key
+  // changes.  The key has to have been read before, false if it is not
+  // hot-linked.
+  bool OnChange(const std::string& key, std::function<void()> callback);
+
+  // Drop the hot-links, call before disconnecting from the experiment.
+  void Close();
+
+ private:
+  struct entry {
+    ParamCache *cache;
+    HNDLE hkey;
+    INT type;
+    std::vector<char> staging;  // the record, written by MIDAS
+    bool stale;                 // the key changed size, link it again
+    std::string str;
+    double num;
+    std::function<void()> on_change;
+  };
+
+  std::mutex mutex_;
+  HNDLE hdb_;
+  std::map<std::string, std::unique_ptr<entry>> entries_;
+
+  // The cached entry of a key, linking it on first use.
+  entry *Link(const std::string& key, INT type, const std::string& def);
+  bool Open(const std::string& key, entry *e, HNDLE hkey,
+            const std::string& def);
+  static void Convert(entry *e);
+  static void Update(HNDLE hDB, HNDLE hkey, void *info);
+};
+
+} // ::util
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_PREARM_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_PREARM_HH_
+
+/*===========================================================================*\
+
+file:   prearm.hh
+
+about:  The ROOT output of the next run, set up on a helper thread
+        between runs so the start transition only has to start the
+        boards.  The output is used at the start if the run number and
+        the output parameters still match, otherwise it is dropped and
+        made again.  The frontend supplies the function that arms a
+        run, which sizes its event data and branches the trees.  The
+        board counts it branched for are kept, the frontend arms again
+        at the start if the hardware came up with others.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <vector>
+#include <future>
+#include <functional>
+
+//--- other includes --------------------------------------------------------//
+#include "TFile.h"
+#include "TTree.h"
+
+//--- project includes ------------------------------------------------------//
+#include "util/param_cache.hh"
+#include "util/root_output.hh"
+
+namespace util {
+
+// Compression, basket and flush settings from /Params/root-compression.
+// An unknown algorithm is reported under the client name.
+root_output_config ReadRootOutputConfig(ParamCache& params,
+                                        const char *client);
+
+// The output parameters an armed run depends on.
+std::string OutputSignature(ParamCache& params);
+
+struct armed_run {
+  int run_number = 0;
+  std::string signature;       // the output parameters it was made with
+  TFile *file = nullptr;       // nullptr without ROOT output
+  std::vector<TTree *> trees;  // in the order they were asked for
+  root_output_config conf;
+  trace_layout layout;
+  std::vector<int> boards;     // the board counts the trees point into
+  std::string error;           // why the run can't start, empty if it can
+  double arm_ms = 0.0;
+};
+
+// Create the file and the empty trees of a run if ROOT output is on.
+// The file name is a printf format of the run number, in the data dir.
+// Trees are given as name and title pairs.
+armed_run OpenRunOutput(
+  ParamCache& params, const char *client, int run_number,
+  const std::string& name_format,
+  const std::vector<std::pair<std::string, std::string>>& trees);
+
+// Drop an output that was armed for a run that didn't happen.
+void Disarm(armed_run &run);
+
+class PreArmer {
+ public:
+  typedef std::function<armed_run(int)> arm_function;
+
+  PreArmer(ParamCache& params);
+
+  // Arm a run on the helper thread, with normal scheduling.
+  void Launch(arm_function arm, int run_number);
+
+  // The output of a run, the armed one if it still fits, else armed
+  // here.  A run that failed to arm is armed again, the config may
+  // have been fixed since.  Sets prearmed accordingly.
+  armed_run Take(arm_function arm, int run_number, bool &prearmed);
+
+  // Drop whatever is armed, at frontend exit.
+  void Cancel();
+
+ private:
+  ParamCache& params_;
+  std::future<armed_run> next_run_;
+};
+
+} // ::util
+
+#endif
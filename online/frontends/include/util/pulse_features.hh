@@ -0,0 +1,53 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_PULSE_FEATURES_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_PULSE_FEATURES_HH_
+
+/*===========================================================================*\
+
+file:   pulse_features.hh
+
+about:  Per-channel pulse features computed online from raw digitizer
+        traces.  The reductions run eight samples at a time with SSE2
+        so that a full board can be reduced well within the readout
+        time of a single event.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <vector>
+#include <string>
+
+namespace util {
+
+// The order matters, it is the layout of each channel in the FEAT bank.
+struct pulse_features {
+  float baseline;   // mean of the leading baseline samples
+  float amplitude;  // largest excursion from the baseline, either sign
+  float peak_time;  // sample index of that excursion
+  float integral;   // baseline subtracted sum over the whole trace
+};
+
+const int kFeaturesPerChannel = sizeof(pulse_features) / sizeof(float);
+
+// Settings for the optional feature stage in the SIS frontends.
+struct feature_config {
+  bool enabled;
+  int baseline_samples;     // leading samples used for the baseline
+  int trace_prescale;       // keep full traces every n-th event, 0 never
+  float anomaly_amplitude;  // keep full traces above this, 0 disables
+};
+
+// Reduce one trace of len samples.
+void ExtractFeatures(const unsigned short *trace, int len,
+                     int baseline_samples, pulse_features &feat);
+
+// Reduce num_ch traces stored back to back, writing them to feats.
+void ExtractFeatures(const unsigned short *traces, int num_ch, int len,
+                     int baseline_samples, pulse_features *feats);
+
+// True if any channel crosses the anomaly amplitude.
+bool IsAnomalous(const pulse_features *feats, int num_ch,
+                 const feature_config &conf);
+
+} // ::util
+
+#endif
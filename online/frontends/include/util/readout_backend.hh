@@ -0,0 +1,83 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_READOUT_BACKEND_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_READOUT_BACKEND_HH_
+
+/*===========================================================================*\
+
+file:   readout_backend.hh
+
+about:  The interface the SIS frontends use to talk to digitizers.  It
+        mirrors daq::EventManagerBasic so the hardware can be swapped
+        for a simulated crate by the JSON config, using
+
+          "simulation": { "enabled": true, ... }
+
+        see sim_event_manager.hh for the simulation settings.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+#include "event_manager_basic.hh"
+
+namespace util {
+
+class ReadoutBackend {
+ public:
+  virtual ~ReadoutBackend() {};
+
+  virtual int BeginOfRun() = 0;
+  virtual int EndOfRun() = 0;
+  virtual int PauseRun() = 0;
+  virtual int ResumeRun() = 0;
+  virtual int ResizeEventData(daq::event_data &data) = 0;
+
+  virtual bool HasEvent() = 0;
+  virtual const daq::event_data &GetCurrentEvent() = 0;
+  virtual void PopCurrentEvent() = 0;
+
+  // Triggers lost to a full queue in the current run, if tracked.
+  virtual unsigned long long dropped_events() const { return 0; };
+};
+
+// Forwards to the VME event manager of the core library.
+class HardwareBackend : public ReadoutBackend {
+ public:
+  HardwareBackend(const std::string& conf_file) :
+    event_manager_(conf_file) {};
+
+  int BeginOfRun() { return event_manager_.BeginOfRun(); };
+  int EndOfRun() { return event_manager_.EndOfRun(); };
+  int PauseRun() { return event_manager_.PauseRun(); };
+  int ResumeRun() { return event_manager_.ResumeRun(); };
+  int ResizeEventData(daq::event_data &data) {
+    return event_manager_.ResizeEventData(data);
+  };
+
+  bool HasEvent() { return event_manager_.HasEvent(); };
+  const daq::event_data &GetCurrentEvent() {
+    return Keep(event_manager_.GetCurrentEvent());
+  };
+  void PopCurrentEvent() { event_manager_.PopCurrentEvent(); };
+
+ private:
+  daq::EventManagerBasic event_manager_;
+  daq::event_data current_;
+
+  // Pass a returned reference through, but hold on to a returned copy
+  // so no extra copy of the event is made either way.
+  const daq::event_data &Keep(const daq::event_data &data) { return data; };
+  const daq::event_data &Keep(daq::event_data &&data) {
+    current_ = std::move(data);
+    return current_;
+  };
+};
+
+// Pick the simulated or the hardware backend from the JSON config.
+ReadoutBackend *MakeReadoutBackend(const std::string& conf_file);
+
+} // ::util
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_READOUT_ODB_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_READOUT_ODB_HH_
+
+/*===========================================================================*\
+
+file:   readout_odb.hh
+
+about:  The ODB side of the readout path the SIS frontends share, the
+        zero-suppression settings from /Params/zero-suppression/<fe>,
+        the poll policy from /Params/readout/<fe>/poll and the metrics
+        of a run under /Equipment/<fe>/Metrics.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+
+//--- project includes ------------------------------------------------------//
+#include "util/param_cache.hh"
+#include "util/realtime.hh"
+#include "util/adaptive_poll.hh"
+#include "util/zero_suppress.hh"
+
+namespace util {
+
+// The zero-suppression settings under a prefix such as
+// "/Params/zero-suppression/fe-sis3302/", the threshold is left to the
+// caller.  Negative window sizes are reported and taken as 0.
+zs_config ReadZeroSuppressConfig(ParamCache& params,
+                                 const std::string& prefix,
+                                 const char *client);
+
+// The poll policy under a prefix such as "/Params/readout/fe-sis3302/"
+// with the equipment period as its window.
+poll_policy ReadPollPolicy(ParamCache& params, const std::string& prefix,
+                           double window_ms);
+
+// Set /Equipment/<equipment>/Metrics/<name>.
+void PublishMetric(const std::string& equipment, const std::string& name,
+                   double val);
+
+// The cost of the start transition and of arming its output.
+void PublishStartMetrics(const std::string& equipment, double start_ms,
+                         double arm_ms, bool prearmed);
+
+// Report and publish the readout latency, the polling cost and the
+// dropped triggers of a run, at its end.
+void PublishReadoutMetrics(const char *client, const std::string& equipment,
+                           const JitterMonitor& jitter,
+                           const AdaptivePoller& poller,
+                           unsigned long long dropped_events);
+
+} // ::util
+
+#endif
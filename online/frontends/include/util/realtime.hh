@@ -0,0 +1,76 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_REALTIME_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_REALTIME_HH_
+
+/*===========================================================================*\
+
+file:   realtime.hh
+
+about:  Helpers to pin the readout path to a set of cores, optionally
+        run it with SCHED_FIFO priority, and keep a histogram of the
+        poll-to-readout latency so that tail jitter can be reported.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <vector>
+#include <chrono>
+
+namespace util {
+
+// Parse a cpu list such as "2,3" or "4-7,10" into core indices.
+std::vector<int> ParseCpuList(const std::string& cpu_list);
+
+// Pin the calling thread (and threads it spawns later) to the cores.
+// An empty list leaves the affinity untouched.  Returns 0 on success.
+int SetThreadAffinity(const std::vector<int>& cpus);
+
+// Move the calling thread to SCHED_FIFO with the given priority.  A
+// priority <= 0 leaves the scheduler untouched.  Returns 0 on success.
+int SetRealtimePriority(int priority);
+
+// Undo both for the calling thread, SCHED_OTHER on any core.  For
+// helpers started from the readout thread.  Returns 0 on success.
+int SetNormalScheduling();
+
+// Fixed-size latency histogram, cheap enough to fill on every event.
+class JitterMonitor {
+ public:
+  JitterMonitor(double bin_width_us=1.0, int num_bins=20000);
+
+  void Reset();
+
+  // Called when poll_event reports an event and when readout starts.
+  inline void MarkPoll() {
+    last_poll_ = std::chrono::steady_clock::now();
+    poll_pending_ = true;
+  };
+  void MarkReadout();
+
+  // Add a latency sample directly.
+  void Fill(double dt_us);
+
+  unsigned long long count() const { return count_; };
+  double mean_us() const { return count_ ? sum_us_ / count_ : 0.0; };
+  double max_us() const { return max_us_; };
+
+  // Latency below which the fraction q of all samples fall.
+  double Percentile(double q) const;
+
+  // One line summary suitable for cm_msg.
+  std::string Report() const;
+
+ private:
+  double bin_width_us_;
+  std::vector<unsigned long long> bins_;
+  unsigned long long overflow_;
+  unsigned long long count_;
+  double sum_us_;
+  double max_us_;
+  bool poll_pending_;
+  std::chrono::steady_clock::time_point last_poll_;
+};
+
+} // ::util
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_ROOT_OUTPUT_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_ROOT_OUTPUT_HH_
+
+/*===========================================================================*\
+
+file:   root_output.hh
+
+about:  Branch layouts for digitizer boards in the ROOT output.  The
+        leaflist layout packs a whole board into one branch, the split
+        layout gives the clocks and every channel trace their own
+        branch so a reader can load one channel without decompressing
+        the rest of the board.
+
+          <board>_system_clock   system_clock/l
+          <board>_device_clock   device_clock[CH]/l
+          <board>_chNN           trace[LN]/s
+
+        Both layouts share the in-memory board struct, so the readers
+        below work on files written with either one.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <algorithm>
+#include <stdio.h>
+
+//--- other includes --------------------------------------------------------//
+#include "TTree.h"
+#include "TBranch.h"
+
+namespace util {
+
+enum trace_layout {
+  kLeafListLayout,
+  kSplitLayout
+};
+
+// Parse the /Params/root-layout string, anything unknown means split.
+inline trace_layout ParseTraceLayout(const std::string& layout)
+{
+  if (layout == "leaflist") {
+    return kLeafListLayout;
+  }
+
+  return kSplitLayout;
+}
+
+// Compression, basket and flush settings from /Params/root-compression.
+struct root_output_config {
+  std::string algorithm;  // LZ4, ZSTD, ZLIB or LZMA
+  int level;              // 0 disables compression
+  int basket_size;        // bytes per trace basket, <= 0 picks one
+  int flush_bytes;        // AutoFlush every n bytes, 0 disables
+  int autosave_bytes;     // AutoSave every n bytes, 0 disables
+};
+
+// True for the algorithm names CompressionSettings knows.
+inline bool IsCompressionAlgorithm(const std::string& algorithm)
+{
+  return (algorithm == "ZLIB" || algorithm == "LZMA" ||
+          algorithm == "LZ4" || algorithm == "ZSTD");
+}
+
+// ROOT encodes compression settings as 100 * algorithm + level.  ZSTD
+// needs ROOT 6.20 or later.  Unknown names fall back to ZLIB, check
+// them with IsCompressionAlgorithm first.
+inline int CompressionSettings(const std::string& algorithm, int level)
+{
+  int algo = 1;
+
+  if (level <= 0) {
+    return 0;
+
+  } else if (algorithm == "LZMA") {
+    algo = 2;
+
+  } else if (algorithm == "LZ4") {
+    algo = 4;
+
+  } else if (algorithm == "ZSTD") {
+    algo = 5;
+  }
+
+  return algo * 100 + std::min(level, 9);
+}
+
+// Apply the flush policy, byte counts are passed to ROOT as negatives.
+inline void SetFlushPolicy(TTree *t, const root_output_config &conf)
+{
+  t->SetAutoFlush(-(Long64_t)conf.flush_bytes);
+  t->SetAutoSave(-(Long64_t)conf.autosave_bytes);
+}
+
+// Basket size that holds a few events of one trace, within sane limits.
+inline int TraceBasketSize(int bytes_per_entry, int entries=32)
+{
+  return std::max(32000, std::min(bytes_per_entry * entries, 4000000));
+}
+
+// Create the branches for one board.  A basket_size <= 0 picks one.
+template <typename T>
+void BranchBoard(TTree *t, const std::string& name, T &board,
+                 trace_layout layout, int basket_size=0)
+{
+  const int num_ch = sizeof(board.trace) / sizeof(board.trace[0]);
+  const int num_ln = sizeof(board.trace[0]) / sizeof(board.trace[0][0]);
+  char branch_vars[100];
+  char branch_name[100];
+
+  if (layout == kLeafListLayout) {
+
+    sprintf(branch_vars, "system_clock/l:device_clock[%i]/l:trace[%i][%i]/s",
+            num_ch, num_ch, num_ln);
+
+    if (basket_size <= 0) {
+      basket_size = TraceBasketSize(sizeof(board));
+    }
+
+    t->Branch(name.c_str(), &board, branch_vars, basket_size);
+    return;
+  }
+
+  // The clocks are tiny, default baskets hold thousands of entries.
+  sprintf(branch_name, "%s_system_clock", name.c_str());
+  t->Branch(branch_name, &board.system_clock, "system_clock/l");
+
+  sprintf(branch_name, "%s_device_clock", name.c_str());
+  sprintf(branch_vars, "device_clock[%i]/l", num_ch);
+  t->Branch(branch_name, &board.device_clock[0], branch_vars);
+
+  if (basket_size <= 0) {
+    basket_size = TraceBasketSize(sizeof(board.trace[0]));
+  }
+
+  for (int ch = 0; ch < num_ch; ++ch) {
+    sprintf(branch_name, "%s_ch%02i", name.c_str(), ch);
+    sprintf(branch_vars, "trace[%i]/s", num_ln);
+    t->Branch(branch_name, &board.trace[ch][0], branch_vars, basket_size);
+  }
+}
+
+// True if a board with this name is in the tree, in either layout.
+inline bool HasBoard(TTree *t, const std::string& name)
+{
+  return (t->GetBranch(name.c_str()) != nullptr) ||
+    (t->GetBranch((name + "_system_clock").c_str()) != nullptr);
+}
+
+// Point a reader at one board.  With the split layout only the clocks
+// (if with_clocks) and the requested channel (all if channel < 0) are
+// enabled, so call SetBranchStatus("*", 0) first to skip everything
+// else.  Returns false if the board is not in the tree.
+template <typename T>
+bool SetBoardAddress(TTree *t, const std::string& name, T &board,
+                     int channel=-1, bool with_clocks=true)
+{
+  const int num_ch = sizeof(board.trace) / sizeof(board.trace[0]);
+  char branch_name[100];
+
+  if (t->GetBranch(name.c_str()) != nullptr) {
+    t->SetBranchStatus(name.c_str(), 1);
+    t->SetBranchAddress(name.c_str(), &board);
+    return true;
+  }
+
+  sprintf(branch_name, "%s_system_clock", name.c_str());
+  if (t->GetBranch(branch_name) == nullptr) {
+    return false;
+  }
+
+  if (with_clocks) {
+    t->SetBranchStatus(branch_name, 1);
+    t->SetBranchAddress(branch_name, &board.system_clock);
+
+    sprintf(branch_name, "%s_device_clock", name.c_str());
+    t->SetBranchStatus(branch_name, 1);
+    t->SetBranchAddress(branch_name, &board.device_clock[0]);
+  }
+
+  for (int ch = 0; ch < num_ch; ++ch) {
+
+    if (channel >= 0 && ch != channel) continue;
+
+    sprintf(branch_name, "%s_ch%02i", name.c_str(), ch);
+    t->SetBranchStatus(branch_name, 1);
+    t->SetBranchAddress(branch_name, &board.trace[ch][0]);
+  }
+
+  return true;
+}
+
+} // ::util
+
+#endif
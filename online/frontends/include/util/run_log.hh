@@ -0,0 +1,99 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_RUN_LOG_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_RUN_LOG_HH_
+
+/*===========================================================================*\
+
+file:   run_log.hh
+
+about:  The run log, kept as a SQLite database next to the MIDAS logs.
+        One row per run plus indexed tag and file tables, so adding a
+        run is a single insert and queries by run, tag or date don't
+        scan the history.
+
+          runs(run, start_time, stop_time, events, comment, config,
+               start_unix, stop_unix)
+          tags(tag, run)
+          files(run, path)
+
+        It replaces runlog.json and runlog.txt, ImportJson brings an old
+        runlog.json over once.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <vector>
+
+//--- other includes --------------------------------------------------------//
+#include <sqlite3.h>
+
+namespace util {
+
+struct run_entry {
+  int run;
+  std::string start_time;
+  std::string stop_time;
+  long long events;
+  std::string comment;
+  std::string config;             // the config manifest of the run
+  std::vector<std::string> tags;
+  std::vector<std::string> files;  // data files written for the run
+  long long start_unix;
+  long long stop_unix;
+};
+
+// Catalog query, empty or zero fields match everything.  The times
+// select runs that started in [from, to).
+struct run_query {
+  std::string tag;
+  long long from;
+  long long to;
+  int limit;
+};
+
+// Split a comma separated tag list, trimming spaces and empty tags.
+std::vector<std::string> SplitTags(const std::string& tags);
+
+// Local "YYYY-MM-DD[ HH:MM[:SS]]" to unix time, 0 if empty, -1 if bad.
+long long ParseDate(const std::string& date);
+
+// Entries as a JSON array, for the CLI and the ODB query service.
+std::string ToJson(const std::vector<run_entry>& entries);
+
+class RunLog {
+ public:
+  RunLog();
+  ~RunLog();
+
+  // Open or create the database, false on failure, see error().
+  bool Open(const std::string& db_file);
+  void Close();
+
+  // Insert or replace the entry of one run.
+  bool Append(const run_entry& entry);
+
+  bool Find(int run, run_entry& entry);
+  std::vector<int> FindByTag(const std::string& tag);
+
+  // Runs matching a query, newest first, with tags and files filled.
+  std::vector<run_entry> Query(const run_query& query);
+
+  // Copy comments and tags from an old runlog.json, once.  Returns the
+  // number of runs imported.
+  int ImportJson(const std::string& runlog_json);
+
+  const std::string& error() const { return error_; };
+
+ private:
+  sqlite3 *db_;
+  std::string error_;
+
+  bool Exec(const char *sql);
+  bool Check(int status);
+  void ReadRow(sqlite3_stmt *stmt, run_entry& entry);
+  void ReadLists(run_entry& entry);
+};
+
+} // ::util
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_SIM_EVENT_MANAGER_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_SIM_EVENT_MANAGER_HH_
+
+/*===========================================================================*\
+
+file:   sim_event_manager.hh
+
+about:  A simulated crate of SIS digitizers.  The boards are taken from
+        the "devices" block of the usual config and triggered at a
+        configurable rate, every channel getting an FID with noise.
+
+          "simulation": {
+              "enabled": true,
+              "rate": 10.0,          // triggers per second, 0 is afap
+              "poisson": true,       // random instead of fixed spacing
+              "canned_events": 0,    // > 0 cycles pre-generated events
+              "queue_depth": 64,     // triggers beyond this are dropped
+              "seed": 42,
+              "sample_rate": 10.0e6,
+              "frequency": 50.0e3,
+              "t2": 5.0e-3,
+              "amplitude": 4000.0,
+              "baseline": 8192.0,
+              "noise": 5.0,
+              "trace_length": 0      // samples with signal, 0 is all
+          }
+
+        Samples past trace_length sit at the baseline, which models a
+        shorter record once zero-suppression is enabled.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+
+//--- project includes ------------------------------------------------------//
+#include "util/readout_backend.hh"
+#include "util/fid_generator.hh"
+
+namespace util {
+
+class SimEventManager : public ReadoutBackend {
+ public:
+  SimEventManager(const std::string& conf_file);
+  ~SimEventManager();
+
+  int BeginOfRun();
+  int EndOfRun();
+  int PauseRun();
+  int ResumeRun();
+  int ResizeEventData(daq::event_data &data);
+
+  bool HasEvent();
+  const daq::event_data &GetCurrentEvent();
+  void PopCurrentEvent();
+
+  // Triggers lost to a full queue in the current run.
+  unsigned long long dropped_events() const { return dropped_events_; };
+
+ private:
+  int num_sis3316_;
+  int num_sis3302_;
+  double rate_;
+  bool poisson_;
+  int canned_events_;
+  unsigned int queue_depth_;
+  unsigned int seed_;
+  int trace_length_;
+  fid_config fid_;
+
+  std::deque<daq::event_data> queue_;
+  std::mutex queue_mutex_;
+  std::vector<daq::event_data> canned_;
+  std::thread trigger_thread_;
+  std::atomic<bool> thread_live_;
+  std::atomic<bool> paused_;
+  std::atomic<unsigned long long> dropped_events_;
+
+  bool HasRoom();
+  void GenerateEvent(FidGenerator &gen, daq::event_data &data);
+  void TriggerLoop();
+};
+
+} // ::util
+
+#endif
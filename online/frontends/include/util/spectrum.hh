@@ -0,0 +1,98 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_SPECTRUM_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_SPECTRUM_HH_
+
+/*===========================================================================*\
+
+file:   spectrum.hh
+
+about:  Running power spectra of every channel of a digitizer.  Each
+        event adds to an exponential average, an average over the last
+        N events, and a rolling spectrogram whose rows each average a
+        fixed number of events.  Everything is allocated by Reset, so
+        the memory stays the same however long the run is.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+//--- other includes --------------------------------------------------------//
+#include <fftw3.h>
+
+namespace util {
+
+struct spectrum_config {
+  double alpha = 0.05;  // weight of the newest event in the exp average
+  int window = 32;      // events in the windowed average
+  int rows = 120;       // spectrogram rows kept
+  int row_events = 32;  // events averaged into each spectrogram row
+  int bins = 256;       // spectrogram columns, frequency bins are merged
+};
+
+class SpectrumAccumulator {
+ public:
+  // dt is the sample period in seconds.
+  SpectrumAccumulator(int num_ch, int trace_len, double dt);
+  ~SpectrumAccumulator();
+
+  // Drop what was accumulated and size the buffers for conf.
+  void Reset(const spectrum_config& conf);
+
+  // Add an event, num_ch traces of trace_len samples back to back.
+  // Only one thread may fill, any thread may read.
+  void Fill(const uint16_t *traces);
+
+  // Power per frequency bin, empty before the first event.
+  void ExpAverage(int ch, std::vector<double>& power);
+  void WindowAverage(int ch, std::vector<double>& power);
+
+  // The finished spectrogram rows of a channel, oldest first, each
+  // num_cols wide.  Returns the number of rows.  Both come from one
+  // look at the spectra, so a Reset can't resize them in between.
+  int Spectrogram(int ch, std::vector<float>& rows, int& num_cols);
+
+  const std::vector<double>& freq() const { return freq_; };
+  int num_ch() const { return num_ch_; };
+  int num_bins() const { return num_bins_; };
+  long long num_events();
+
+  // Memory held by the accumulated spectra.
+  size_t bytes();
+
+ private:
+  int num_ch_;
+  int trace_len_;
+  int num_bins_;
+  std::vector<double> freq_;
+
+  // FFT buffers, only touched by Fill.
+  fftw_plan plan_;
+  double *in_;
+  fftw_complex *out_;
+  std::vector<double> taper_;
+  std::vector<double> power_;  // num_ch x num_bins, the newest event
+
+  std::mutex mutex_;
+  spectrum_config conf_;
+  long long num_events_;
+
+  // Per channel, num_ch x num_bins.
+  std::vector<double> exp_avg_;
+  std::vector<double> window_sum_;
+  std::vector<float> window_;  // num_ch x window x num_bins ring
+  int window_next_;
+
+  // Spectrogram, num_ch x rows x bins ring plus the row being summed.
+  std::vector<float> rows_;
+  std::vector<double> row_sum_;
+  int row_count_;
+  int row_next_;
+  int rows_done_;
+};
+
+} // ::util
+
+#endif
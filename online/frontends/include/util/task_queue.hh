@@ -0,0 +1,53 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_TASK_QUEUE_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_TASK_QUEUE_HH_
+
+/*===========================================================================*\
+
+file:   task_queue.hh
+
+about:  Worker threads that sleep on a condition variable until a
+        task is posted, instead of polling flags.  Tasks start in the
+        order posted, at most num_workers at a time.  Stop finishes
+        what is queued and joins.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace util {
+
+class TaskQueue {
+ public:
+  TaskQueue();
+  ~TaskQueue();
+
+  void Start(int num_workers=1);
+
+  // Queue a task, false once stopped.
+  bool Post(std::function<void()> task);
+
+  // Run the tasks still queued, then join the worker.
+  void Stop();
+
+  // Tasks waiting for a worker.
+  int queued();
+
+ private:
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::thread> workers_;
+  bool stop_;
+
+  void WorkLoop();
+};
+
+} // ::util
+
+#endif
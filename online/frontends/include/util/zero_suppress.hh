@@ -0,0 +1,45 @@
+#ifndef SIMPLE_DAQ_INCLUDE_UTIL_ZERO_SUPPRESS_HH_
+#define SIMPLE_DAQ_INCLUDE_UTIL_ZERO_SUPPRESS_HH_
+
+/*===========================================================================*\
+
+file:   zero_suppress.hh
+
+about:  Threshold based zero-suppression of digitizer traces.  Only the
+        sample windows around threshold crossings are kept.  The sparse
+        format is a flat stream of 16-bit words so it fits a TID_WORD
+        bank, 32-bit fields are stored as a low word followed by a high
+        word.  For each channel
+
+          baseline, num_windows (32)
+          num_windows x { start (32), length (32), samples[length] }
+
+        Suppressed samples are restored as the channel baseline.
+
+\*===========================================================================*/
+
+namespace util {
+
+struct zs_config {
+  bool enabled;
+  float threshold;       // ADC counts away from the baseline
+  int pre_samples;       // samples kept before a crossing
+  int post_samples;      // samples kept after a crossing
+  int baseline_samples;  // leading samples used for the baseline
+};
+
+// Number of words the sparse stream of num_ch traces can take at most.
+int ZeroSuppressMaxWords(int num_ch, int len);
+
+// Encode num_ch back to back traces, returns the number of words used.
+int ZeroSuppress(const unsigned short *traces, int num_ch, int len,
+                 const zs_config &conf, unsigned short *out);
+
+// Rebuild dense traces from a sparse stream of num_words words.  Returns
+// false if the stream does not describe num_ch traces of len samples.
+bool ZeroSuppressDecode(const unsigned short *in, int num_words,
+                        int num_ch, int len, unsigned short *traces);
+
+} // ::util
+
+#endif
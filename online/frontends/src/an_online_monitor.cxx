@@ -14,11 +14,23 @@ about:  Performs FFTs and plots those as well waveforms for simple
 #include <time.h>
 #include <cstring>
 #include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <glob.h>
+#include <set>
+#include <map>
+#include <mutex>
+#include <future>
+#include <thread>
+#include <functional>
+#include <unistd.h>
 
 //--- other includes ---------------------------------------------------------//
 #include "TFile.h"
 #include "TTree.h"
 #include "TH1F.h"
+#include "TH2F.h"
+#include "TCanvas.h"
 #include "TROOT.h"
 #include "TStyle.h"
 
@@ -29,6 +41,17 @@ about:  Performs FFTs and plots those as well waveforms for simple
 #include "experim.h"
 #include "fid.h"
 #include "common.hh"
+#include "util/zero_suppress.hh"
+#include "util/config_store.hh"
+#include "util/run_log.hh"
+#include "util/task_queue.hh"
+#include "util/param_cache.hh"
+#include "util/file_pipeline.hh"
+#include "util/convert.hh"
+#include "util/spectrum.hh"
+#include "util/mpmc_queue.hh"
+#include "util/channel_stats.hh"
+#include "util/bank_view.hh"
 
 //--- globals ----------------------------------------------------------------//
 
@@ -90,80 +113,231 @@ ANALYZE_REQUEST analyze_request[] = {
 
 namespace {
 
+// Hot-linked ODB parameters, read from the main thread and the jobs.
+util::ParamCache params;
+
 // Histograms for a subset of MIDAS banks.
 std::string figdir;
 bool write_root;
-WORD p_sis3302[SIS_3302_CH][SIS_3302_LN];
-WORD p_sis3316[SIS_3316_CH][SIS_3316_LN];;
-std::atomic<bool> new_run_to_process;
-std::atomic<bool> new_config_to_archive;
+typedef util::TraceView<WORD> trace_view;
+
+// The traces being plotted, owned by the plot thread while plot_pending.
+std::vector<WORD> p_sis3302;
+std::vector<WORD> p_sis3316;
 std::atomic<bool> new_sis3302_waveforms;
 std::atomic<bool> new_sis3316_waveforms;
-std::atomic<bool> time_for_breakdown;
-std::atomic<int> atomic_run_number;
-std::thread merge_root_thread;
-std::thread plot_waveforms_thread;
-std::thread archive_config_thread;
+std::atomic<bool> plot_pending;
+
+// Running spectra of every event received, drawn with the waveforms.
+util::SpectrumAccumulator *sis3302_spectra = nullptr;
+util::SpectrumAccumulator *sis3316_spectra = nullptr;
+
+// Per-channel baseline, noise and rates, published for the history.
+util::ChannelStats *sis3302_stats = nullptr;
+util::ChannelStats *sis3316_stats = nullptr;
+
+// Full-rate mode, every event is copied to a slot and analyzed by the
+// worker pool.  Free slot numbers wait in free_slots, filled ones in
+// full_slots.
+struct full_rate_event {
+  DWORD time;
+  std::vector<WORD> sis3302;  // empty if the event had none
+  std::vector<WORD> sis3316;
+};
+
+// Histograms of one worker, merged when they are drawn.
+struct full_rate_stats {
+  std::mutex mutex;
+  std::vector<double> sis3302_amp;  // SIS_3302_CH x kAmpBins
+  std::vector<double> sis3316_amp;  // SIS_3316_CH x kAmpBins
+  std::vector<DWORD> rate_time;     // ring of the last kRateSeconds
+  std::vector<double> rate_count;
+};
+
+const int kAmpBins = 256;
+const int kRateSeconds = 600;
+
+bool full_rate = false;
+int num_slots;
+int num_workers;
+std::vector<full_rate_event> slots;
+util::BlockingMpmcQueue<int> *free_slots = nullptr;
+util::BlockingMpmcQueue<int> *full_slots = nullptr;
+full_rate_stats *worker_stats = nullptr;
+util::TaskQueue full_rate_pool;
+std::atomic<long long> events_processed;
+std::atomic<long long> queue_stalls;
+std::atomic<long long> banks_rejected;
+std::chrono::steady_clock::time_point full_rate_start;
+
+// One filler at a time for the spectra, busy ones are skipped.
+std::mutex sis3302_fill_mutex;
+std::mutex sis3316_fill_mutex;
+
+// Worker threads, they sleep until a stop or an event posts work.
+util::TaskQueue run_jobs;
+util::TaskQueue plot_queue;
+
+// Progress of the stop jobs, mirrored in /Equipment/online-monitor/Jobs.
+std::mutex jobs_mutex;
+int jobs_queued;
+int jobs_running;
+int jobs_done;
+int jobs_failed;
+std::set<std::string> jobs_active;
+std::map<int, int> jobs_left;  // unfinished jobs of each run
+
+// Throughput seen by the analyzer, published from analyzer_loop.
+double events_received;
+double bytes_received;
+
+// Run catalog queries are answered from the main thread.
+util::RunLog catalog;
 }
 
-void merge_data_loop();
-void plot_waveforms_loop();
-void archive_config_loop();
+void publish_metrics();
+void publish_channel_stats();
+void catalog_query();
+
+void post_run_job(const char *name, int run_number,
+                  const std::function<bool(int)>& job);
+void update_jobs(const std::string& last);
+bool merge_data(int run_number);
+bool check_run_file(int run_number, const std::string& merged,
+                    const std::map<std::string, long long>& entries,
+                    const std::vector<std::string>& sources);
+util::run_entry stop_entry(int run_number);
+bool archive_config(util::run_entry entry);
+void plot_waveforms();
+void plot_spectra(const char *prefix, util::SpectrumAccumulator& spectra,
+                  TCanvas& c1);
+util::spectrum_config spectrum_params();
+trace_view unpack_sis3302(void *pevent);
+trace_view unpack_sis3316(void *pevent);
+void monitor_traces(const trace_view& sis3302, const trace_view& sis3316);
+void plot_traces(const char *prefix, const std::vector<WORD>& traces,
+                 int num_ch, int first_ch, TCanvas& c1);
+void queue_event(EVENT_HEADER *pheader, void *pevent);
+void full_rate_worker(int id);
+void reset_full_rate();
+void plot_full_rate(TCanvas& c1);
 
 //-- Analyzer Init ---------------------------------------------------------//
 
 INT analyzer_init()
 {
   HNDLE hDB, hkey;
-  char str[256];
-  int i, size;
-
-  // Set up data merging thread.
-  ::new_run_to_process = false;
-  ::time_for_breakdown = false;
-  ::atomic_run_number = 0;
-  ::merge_root_thread = std::thread(merge_data_loop);
-  ::archive_config_thread = std::thread(archive_config_loop);
-  ::plot_waveforms_thread = std::thread(plot_waveforms_loop);
-
-  // Register my own stop hook.
-  cm_register_transition(TR_STOP, tr_stop_hook, 900);  
+  int i;
 
   // following code opens ODB structures to make them accessible
   // from the analyzer code as C structures 
   cm_get_experiment_database(&hDB, NULL);
-  db_find_key(hDB, 0, "/Params/html-dir", &hkey);
-  
-  if (hkey) {
-    size = sizeof(str);
-    db_get_data(hDB, hkey, str, &size, TID_STRING);
-    if (str[strlen(str) - 1] != DIR_SEPARATOR) {
-      strcat(str, DIR_SEPARATOR_STR);
-    }
-  }
 
-  db_find_key(hDB, 0, "/Params/root-output", &hkey);
-  if (hkey) {
+  // Set up the worker threads, the merges of several runs can overlap.
+  int max_jobs = params.Int("/Params/run-jobs/max-concurrent", 2);
+
+  ROOT::EnableThreadSafety();
+
+  // The FFTs are planned here, before the plot thread plans its own.
+  ::sis3302_spectra = new util::SpectrumAccumulator(SIS_3302_CH, SIS_3302_LN,
+                                                    0.0001);
+  ::sis3316_spectra = new util::SpectrumAccumulator(SIS_3316_CH, SIS_3316_LN,
+                                                    0.0001);
+  ::sis3302_spectra->Reset(spectrum_params());
+  ::sis3316_spectra->Reset(spectrum_params());
+
+  int baseline_len = params.Int("/Params/channel-stats/baseline-samples", 64);
+  ::sis3302_stats = new util::ChannelStats(SIS_3302_CH, SIS_3302_LN,
+                                           baseline_len);
+  ::sis3316_stats = new util::ChannelStats(SIS_3316_CH, SIS_3316_LN,
+                                           baseline_len);
+
+  ::new_sis3302_waveforms = false;
+  ::new_sis3316_waveforms = false;
+  ::plot_pending = false;
+  ::banks_rejected = 0;
+  ::jobs_queued = 0;
+  ::jobs_running = 0;
+  ::jobs_done = 0;
+  ::jobs_failed = 0;
+  ::run_jobs.Start(max_jobs);
+  ::plot_queue.Start();
+  update_jobs("");
+
+  // Full-rate mode asks for every event rather than those the monitor
+  // keeps up with, so it is set before the request is registered.
+  full_rate = params.Bool("/Params/full-rate/enabled", false);
+
+  if (full_rate) {
+    num_slots = std::max(params.Int("/Params/full-rate/slots", 64), 1);
+    num_workers = std::max(params.Int("/Params/full-rate/workers", 4), 1);
+
+    analyze_request[0].ar_info.sampling_type = GET_ALL;
+
+    slots.resize(num_slots);
+    free_slots = new util::BlockingMpmcQueue<int>(num_slots);
+    full_slots = new util::BlockingMpmcQueue<int>(num_slots);
+
+    for (i = 0; i < num_slots; ++i) {
+      free_slots->TryPush(i);
+    }
 
-    BOOL mstatus;
-    size = sizeof(mstatus);
+    worker_stats = new full_rate_stats[num_workers];
+    reset_full_rate();
 
-    db_get_data(hDB, hkey, &mstatus, &size, TID_BOOL);
-    write_root = mstatus;
+    full_rate_pool.Start(num_workers);
 
-  } else {
+    for (i = 0; i < num_workers; ++i) {
+      full_rate_pool.Post([i] { full_rate_worker(i); });
+    }
 
-    write_root = false;
+    cm_msg(MINFO, "online_analyzer", "full-rate mode, %i workers, %i slots",
+           num_workers, num_slots);
   }
+
+  // Register my own stop hook.
+  cm_register_transition(TR_STOP, tr_stop_hook, 900);  
+
+  write_root = params.Bool("/Params/root-output", true);
   
+  // Serve run catalog queries, set the fields under /Params/run-catalog
+  // and bump query-id, the runs show up as JSON in result.
+  if (catalog.Open(params.Dir("/Logger/Log Dir") + "runlog.sqlite")) {
+    params.String("/Params/run-catalog/tag");
+    params.String("/Params/run-catalog/from");
+    params.String("/Params/run-catalog/to");
+    params.Int("/Params/run-catalog/limit", 100);
+    params.Int("/Params/run-catalog/query-id");
+
+    if (!params.OnChange("/Params/run-catalog/query-id", catalog_query)) {
+      cm_msg(MERROR, "online_analyzer", "cannot watch "
+             "/Params/run-catalog/query-id, run catalog queries disabled");
+    }
+
+  } else {
+    cm_msg(MERROR, "online_analyzer", "run catalog unavailable: %s",
+           catalog.error().c_str());
+  }
+
   // Filepaths are too long, so moving to /tmp
   //  figdir = std::string(str) + std::string("static/");
   figdir = std::string("/tmp");
   gROOT->SetBatch(true);
   gStyle->SetOptStat(false);
 
+  if (full_rate) {
+    for (auto name : {"full_rate_rate", "sis3302_amplitude",
+                      "sis3316_amplitude"}) {
+      char key[64], figpath[64];
+      sprintf(key, "/Custom/Images/%s.gif/Background", name);
+      sprintf(figpath, "%s/%s.gif", figdir.c_str(), name);
+      db_create_key(hDB, 0, key, TID_STRING);
+      db_set_value(hDB, 0, key, figpath, sizeof(figpath), 1, TID_STRING);
+    }
+  }
+
   // Check if we need to put the images in.
-  char keyname[] = "Custom/Images/sis3302_ch03_fft.gif/Background";
+  char keyname[] = "Custom/Images/sis3302_ch03_spectrogram.gif/Background";
   cm_get_experiment_database(&hDB, NULL);
   db_find_key(hDB, 0, keyname, &hkey);
 
@@ -188,6 +362,15 @@ INT analyzer_init()
     sprintf(figpath, "%s/%s.gif", figdir.c_str(), name);
     db_create_key(hDB, 0, key, TID_STRING);
     db_set_value(hDB, 0, key, figpath, sizeof(figpath), 1, TID_STRING);
+
+    // And the running averages.
+    for (auto plot : {"fft_avg", "spectrogram"}) {
+      sprintf(name, "sis3316_ch%02i_%s", i, plot);
+      sprintf(key, "/Custom/Images/%s.gif/Background", name);
+      sprintf(figpath, "%s/%s.gif", figdir.c_str(), name);
+      db_create_key(hDB, 0, key, TID_STRING);
+      db_set_value(hDB, 0, key, figpath, sizeof(figpath), 1, TID_STRING);
+    }
   }
 
   for (i = 0; i < SIS_3302_CH; i++) {
@@ -206,6 +389,15 @@ INT analyzer_init()
     sprintf(figpath, "%s/%s.gif", figdir.c_str(), name);
     db_create_key(hDB, 0, key, TID_STRING);
     db_set_value(hDB, 0, key, figpath, sizeof(figpath), 1, TID_STRING);
+
+    // And the running averages.
+    for (auto plot : {"fft_avg", "spectrogram"}) {
+      sprintf(name, "sis3302_ch%02i_%s", i, plot);
+      sprintf(key, "/Custom/Images/%s.gif/Background", name);
+      sprintf(figpath, "%s/%s.gif", figdir.c_str(), name);
+      db_create_key(hDB, 0, key, TID_STRING);
+      db_set_value(hDB, 0, key, figpath, sizeof(figpath), 1, TID_STRING);
+    }
   }
 
   return SUCCESS;
@@ -215,11 +407,27 @@ INT analyzer_init()
 
 INT analyzer_exit()
 {
-  time_for_breakdown = true;
+  // The full-rate workers post plots, so they go first.
+  if (full_rate) {
+    full_slots->Close();
+    full_rate_pool.Stop();
+
+    delete free_slots;
+    delete full_slots;
+    delete[] worker_stats;
+  }
 
-  while(!merge_root_thread.joinable());
-  
-  merge_root_thread.join();
+  // Finish the run jobs still queued and join all the workers.
+  run_jobs.Stop();
+  plot_queue.Stop();
+
+  delete sis3302_spectra;
+  delete sis3316_spectra;
+  delete sis3302_stats;
+  delete sis3316_stats;
+
+  catalog.Close();
+  params.Close();
 
   return CM_SUCCESS;
 }
@@ -228,6 +436,19 @@ INT analyzer_exit()
 
 INT ana_begin_of_run(INT run_number, char *error)
 {
+  events_received = 0;
+  bytes_received = 0;
+  sis3302_spectra->Reset(spectrum_params());
+  sis3316_spectra->Reset(spectrum_params());
+
+  if (full_rate) {
+    reset_full_rate();
+  }
+
+  // Start the first interval of the run.
+  publish_channel_stats();
+  publish_metrics();
+
   return CM_SUCCESS;
 }
 
@@ -235,56 +456,31 @@ INT ana_begin_of_run(INT run_number, char *error)
 
 INT ana_end_of_run(INT run_number, char *error)
 {
-  FILE *f;
-  time_t now;
-  char str[256];
-  int size;
-  double n;
-  HNDLE hDB;
-  BOOL flag;
-
-  cm_get_experiment_database(&hDB, NULL);
-
-  // update run log if run was written and running online 
-
-  size = sizeof(flag);
-  db_get_value(hDB, 0, "/Logger/Write data", &flag, &size, TID_BOOL, TRUE);
-  if (flag && runinfo.online_mode == 1) {
-    // update run log 
-    size = sizeof(str);
-    str[0] = 0;
-    db_get_value(hDB, 0, "/Logger/Data Dir", str, &size, TID_STRING, TRUE);
-    if (str[0] != 0)
-      if (str[strlen(str) - 1] != DIR_SEPARATOR)
-        strcat(str, DIR_SEPARATOR_STR);
-    strcat(str, "runlog.txt");
-
-    f = fopen(str, "a");
-
-    time(&now);
-    strcpy(str, ctime(&now));
-    str[10] = 0;
-
-    fprintf(f, "%s\t%3d\t", str, runinfo.run_number);
-
-    strcpy(str, runinfo.start_time);
-    str[19] = 0;
-    fprintf(f, "%s\t", str + 11);
-
-    strcpy(str, ctime(&now));
-    str[19] = 0;
-    fprintf(f, "%s\t", str + 11);
+  // The run log entry is written by archive_config_loop after the stop.
+  if (full_rate) {
+    // Let the workers finish the events of this run first, every slot
+    // is free again once they are done.
+    std::vector<int> idle(num_slots);
+
+    for (auto &slot : idle) {
+      free_slots->Pop(slot);
+    }
 
-    size = sizeof(n);
-    db_get_value(hDB, 0, "/Equipment/fe-sis3302/Statistics/Events sent",
-                 &n, &size, TID_DOUBLE, TRUE);
+    for (int slot : idle) {
+      free_slots->TryPush(slot);
+    }
 
-    fprintf(f, "%dk\t", (int) (n / 1000.0 + 0.5));
-    fprintf(f, "%s\n", exp_param.comment);
+    auto t1 = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(t1 - full_rate_start).count();
 
-    fclose(f);
+    cm_msg(MINFO, "online_analyzer",
+           "full-rate: %lld events in %.1f s, %.1f events/s, %lld stalls",
+           events_processed.load(), dt, events_processed / dt,
+           queue_stalls.load());
   }
 
+  publish_metrics();
+
   return CM_SUCCESS;
 }
 
@@ -307,472 +503,1069 @@ INT ana_resume_run(INT run_number, char *error)
 
 INT analyzer_loop()
 {
+  static auto last_stats = std::chrono::steady_clock::now();
+  double period = params.Double("/Params/channel-stats/period-s", 10.0);
+  auto now = std::chrono::steady_clock::now();
+
+  if (std::chrono::duration<double>(now - last_stats).count() >= period) {
+    publish_channel_stats();
+    last_stats = now;
+  }
+
+  publish_metrics();
+
   return CM_SUCCESS;
 }
 
+// Answer a run catalog query, called when query-id changes.
+void catalog_query()
+{
+  HNDLE hDB, hkey;
+  util::run_query query;
+
+  cm_get_experiment_database(&hDB, NULL);
+
+  std::string from = params.String("/Params/run-catalog/from");
+  std::string to = params.String("/Params/run-catalog/to");
+
+  query.tag = params.String("/Params/run-catalog/tag");
+  query.from = std::max(util::ParseDate(from), 0LL);
+  query.to = std::max(util::ParseDate(to), 0LL);
+  query.limit = params.Int("/Params/run-catalog/limit", 100);
+
+  auto t0 = std::chrono::steady_clock::now();
+  std::string result = util::ToJson(catalog.Query(query));
+  auto t1 = std::chrono::steady_clock::now();
+  double ms = std::chrono::duration<double>(t1 - t0).count() * 1.0e3;
+
+  db_set_value(hDB, 0, "/Params/run-catalog/result", result.c_str(),
+               result.size() + 1, 1, TID_STRING);
+  db_set_value(hDB, 0, "/Params/run-catalog/query-ms", &ms, sizeof(ms),
+               1, TID_DOUBLE);
+}
+
+// Counters and the SYSTEM buffer level for benchmarks and history.
+void publish_metrics()
+{
+  HNDLE hDB, hkey;
+  INT level = 0;
+  double val;
+
+  cm_get_experiment_database(&hDB, NULL);
+
+  db_set_value(hDB, 0, "/Equipment/online-monitor/Metrics/events-received",
+               &events_received, sizeof(events_received), 1, TID_DOUBLE);
+
+  val = bytes_received * 1.0e-6;
+  db_set_value(hDB, 0, "/Equipment/online-monitor/Metrics/mb-received",
+               &val, sizeof(val), 1, TID_DOUBLE);
+
+  val = (sis3302_spectra->bytes() + sis3316_spectra->bytes()) * 1.0e-6;
+  db_set_value(hDB, 0, "/Equipment/online-monitor/Metrics/spectrum-mb",
+               &val, sizeof(val), 1, TID_DOUBLE);
+
+  if (full_rate) {
+    static long long last_processed = 0;
+    static auto last_time = std::chrono::steady_clock::now();
+
+    auto now = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(now - last_time).count();
+    long long processed = events_processed;
+
+    val = processed;
+    db_set_value(hDB, 0, "/Equipment/online-monitor/Metrics/events-processed",
+                 &val, sizeof(val), 1, TID_DOUBLE);
+
+    val = (dt > 0.0) ? std::max(processed - last_processed, 0LL) / dt : 0.0;
+    db_set_value(hDB, 0,
+                 "/Equipment/online-monitor/Metrics/processed-per-s",
+                 &val, sizeof(val), 1, TID_DOUBLE);
+
+    val = queue_stalls;
+    db_set_value(hDB, 0, "/Equipment/online-monitor/Metrics/queue-stalls",
+                 &val, sizeof(val), 1, TID_DOUBLE);
+
+    val = full_slots->size();
+    db_set_value(hDB, 0, "/Equipment/online-monitor/Metrics/queue-depth",
+                 &val, sizeof(val), 1, TID_DOUBLE);
+
+    last_processed = processed;
+    last_time = now;
+  }
+
+  val = banks_rejected;
+  db_set_value(hDB, 0, "/Equipment/online-monitor/Metrics/banks-rejected",
+               &val, sizeof(val), 1, TID_DOUBLE);
+
+  bm_get_buffer_level(analyze_request[0].buffer_handle, &level);
+  val = level;
+  db_set_value(hDB, 0, "/Equipment/online-monitor/Metrics/buffer-level-bytes",
+               &val, sizeof(val), 1, TID_DOUBLE);
+}
+
+// Per-channel summaries of the last interval into the Variables dir,
+// where the history picks them up.  Clears the stats for the next one.
+void publish_channel_stats()
+{
+  static std::vector<util::channel_summary> channels;
+  static std::vector<double> vals;
+
+  const std::pair<const char *, double util::channel_summary::*> fields[] = {
+    {"baseline", &util::channel_summary::baseline},
+    {"rms", &util::channel_summary::rms},
+    {"min", &util::channel_summary::min},
+    {"max", &util::channel_summary::max},
+    {"rate", &util::channel_summary::rate},
+  };
+
+  HNDLE hDB, hkey;
+  char key[128];
+  double event_rate;
+  double threshold = params.Double("/Params/channel-stats/threshold", 100.0);
+
+  cm_get_experiment_database(&hDB, NULL);
+
+  for (auto dev : {std::make_pair("sis3302", sis3302_stats),
+                   std::make_pair("sis3316", sis3316_stats)}) {
+
+    dev.second->set_threshold(threshold);
+    dev.second->Take(channels, event_rate);
+
+    sprintf(key, "/Equipment/online-monitor/Variables/%s-event-rate",
+            dev.first);
+    db_set_value(hDB, 0, key, &event_rate, sizeof(event_rate), 1,
+                 TID_DOUBLE);
+
+    for (auto &field : fields) {
+      vals.clear();
+
+      for (auto &ch : channels) {
+        vals.push_back(ch.*field.second);
+      }
+
+      sprintf(key, "/Equipment/online-monitor/Variables/%s-%s",
+              dev.first, field.first);
+      db_set_value(hDB, 0, key, vals.data(), vals.size() * sizeof(double),
+                   vals.size(), TID_DOUBLE);
+    }
+  }
+}
+
 //-- Analyze Events --------------------------------------------------------//
 
 INT analyze_trigger_event(EVENT_HEADER * pheader, void *pevent)
 {
-  // We need these for each FID, so keep them allocated.
-  unsigned int ch, idx;
+  events_received += 1;
+  bytes_received += pheader->data_size + sizeof(EVENT_HEADER);
+
+  if (full_rate) {
+    queue_event(pheader, pevent);
+    return CM_SUCCESS;
+  }
+
+  monitor_traces(unpack_sis3302(pevent), unpack_sis3316(pevent));
+
+  return CM_SUCCESS;
+}
+
+// The traces of a bank shaped by its size, or by decoding the
+// zero-suppressed version into dense.  Malformed banks are counted and
+// give an invalid view.
+trace_view unpack_traces(void *pevent, const char *name, const char *zs_name,
+                         int num_ch, int zs_len, std::vector<WORD>& dense)
+{
+  bool rejected;
   WORD *pvme;
-  float *pfreq;
+  INT num_words;
 
-  // Look for the first SIS3302 traces.
-  if (bk_locate(pevent, "02_0", &pvme) != 0) {
+  trace_view view = util::LocateTraces(pevent, name, num_ch, &rejected);
 
-    std::copy(&pvme[0], &pvme[SIS_3302_CH *SIS_3316_LN], &p_sis3302[0][0]);
+  if (rejected) {
+    ++banks_rejected;
+  }
 
-    new_sis3302_waveforms = true;
+  if (view || rejected) {
+    return view;
   }
 
-  if (bk_locate(pevent, "16_0", &pvme) != 0) {
+  if ((num_words = bk_locate(pevent, zs_name, &pvme)) != 0) {
+
+    // Zero-suppressed traces, rebuild the dense version.
+    dense.resize(num_ch * zs_len);
 
-    std::copy(&pvme[0], &pvme[SIS_3316_CH *SIS_3316_LN], &p_sis3316[0][0]);
+    if (util::ZeroSuppressDecode(pvme, num_words, num_ch, zs_len,
+                                 dense.data())) {
+      return trace_view(dense.data(), dense.size(), num_ch);
+    }
 
-    new_sis3316_waveforms = true;
+    ++banks_rejected;
   }
 
-  return CM_SUCCESS;
+  return trace_view();
+}
+
+// The first SIS3302 traces of the event, the view is good until the
+// next call from the same thread.
+trace_view unpack_sis3302(void *pevent)
+{
+  static thread_local std::vector<WORD> dense;
+  return unpack_traces(pevent, "02_0", "Z020", SIS_3302_CH, SIS_3302_LN,
+                       dense);
+}
+
+// The first SIS3316 traces of the event, likewise.
+trace_view unpack_sis3316(void *pevent)
+{
+  static thread_local std::vector<WORD> dense;
+  return unpack_traces(pevent, "16_0", "Z160", SIS_3316_CH, SIS_3316_LN,
+                       dense);
+}
+
+// Every event goes into the stats and spectra, the plots only see some.
+// Those are sized for the configured trace length, other lengths are
+// still plotted.
+void monitor_traces(const trace_view& sis3302, const trace_view& sis3316)
+{
+  if (sis3302.len() == SIS_3302_LN) {
+    sis3302_stats->Fill(sis3302.data());
+
+    // The full-rate workers skip the spectra while another one fills.
+    if (sis3302_fill_mutex.try_lock()) {
+      sis3302_spectra->Fill(sis3302.data());
+      sis3302_fill_mutex.unlock();
+    }
+  }
+
+  if (sis3316.len() == SIS_3316_LN) {
+    sis3316_stats->Fill(sis3316.data());
+
+    if (sis3316_fill_mutex.try_lock()) {
+      sis3316_spectra->Fill(sis3316.data());
+      sis3316_fill_mutex.unlock();
+    }
+  }
+
+  // Copy out for the plot thread once it is free, at most one pass is
+  // queued, and it keeps the buffers until it is done.
+  if ((sis3302 || sis3316) && !plot_pending.exchange(true)) {
+
+    if (sis3302) {
+      p_sis3302.assign(sis3302.data(), sis3302.data() + sis3302.size());
+      new_sis3302_waveforms = true;
+    }
+
+    if (sis3316) {
+      p_sis3316.assign(sis3316.data(), sis3316.data() + sis3316.size());
+      new_sis3316_waveforms = true;
+    }
+
+    plot_queue.Post(plot_waveforms);
+  }
+}
+
+// Hand an event to the full-rate workers.  With every slot busy we sleep
+// until a worker frees one rather than drop the event, the SYSTEM buffer
+// holds the rest meanwhile.
+void queue_event(EVENT_HEADER *pheader, void *pevent)
+{
+  int slot;
+
+  // free_slots is never closed, Pop only returns with a slot.
+  if (!free_slots->TryPop(slot)) {
+    ++queue_stalls;
+    free_slots->Pop(slot);
+  }
+
+  full_rate_event& event = slots[slot];
+  trace_view sis3302 = unpack_sis3302(pevent);
+  trace_view sis3316 = unpack_sis3316(pevent);
+
+  // The slot belongs to this thread until it is queued.
+  event.time = pheader->time_stamp;
+  event.sis3302.assign(sis3302.data(), sis3302.data() + sis3302.size());
+  event.sis3316.assign(sis3316.data(), sis3316.data() + sis3316.size());
+
+  // Can't fail, the queue has room for every slot.
+  full_slots->TryPush(slot);
+}
+
+// Peak to peak amplitude of each trace into the channel's histogram.
+void fill_amplitudes(const trace_view& traces, std::vector<double>& hist)
+{
+  for (int ch = 0; ch < traces.num_ch(); ++ch) {
+    auto range = std::minmax_element(traces.trace(ch),
+                                     traces.trace(ch) + traces.len());
+    int amp = *range.second - *range.first;
+
+    hist[ch * kAmpBins + amp * kAmpBins / 65536] += 1;
+  }
+}
+
+// One of the full-rate workers, sleeps while nothing is queued and runs
+// until analyzer_exit closes the queue and it is drained.
+void full_rate_worker(int id)
+{
+  full_rate_stats& stats = worker_stats[id];
+  int slot;
+
+  while (full_slots->Pop(slot)) {
+    full_rate_event& event = slots[slot];
+    trace_view sis3302(event.sis3302.data(), event.sis3302.size(),
+                       SIS_3302_CH);
+    trace_view sis3316(event.sis3316.data(), event.sis3316.size(),
+                       SIS_3316_CH);
+
+    {
+      std::lock_guard<std::mutex> lock(stats.mutex);
+      int idx = event.time % kRateSeconds;
+
+      if (stats.rate_time[idx] != event.time) {
+        stats.rate_time[idx] = event.time;
+        stats.rate_count[idx] = 0;
+      }
+
+      stats.rate_count[idx] += 1;
+
+      if (sis3302) {
+        fill_amplitudes(sis3302, stats.sis3302_amp);
+      }
+
+      if (sis3316) {
+        fill_amplitudes(sis3316, stats.sis3316_amp);
+      }
+    }
+
+    monitor_traces(sis3302, sis3316);
+
+    free_slots->TryPush(slot);
+    ++events_processed;
+  }
 }
 
-void plot_waveforms_loop()
+// Clear the histograms and counters for a new run.
+void reset_full_rate()
+{
+  for (int i = 0; i < num_workers; ++i) {
+    full_rate_stats& stats = worker_stats[i];
+    std::lock_guard<std::mutex> lock(stats.mutex);
+
+    stats.sis3302_amp.assign(SIS_3302_CH * kAmpBins, 0.0);
+    stats.sis3316_amp.assign(SIS_3316_CH * kAmpBins, 0.0);
+    stats.rate_time.assign(kRateSeconds, 0);
+    stats.rate_count.assign(kRateSeconds, 0.0);
+  }
+
+  events_processed = 0;
+  queue_stalls = 0;
+  full_rate_start = std::chrono::steady_clock::now();
+}
+
+void plot_waveforms()
+{
+  static TCanvas c1("c1", "Online Monitor", 360, 270);
+
+  if (new_sis3302_waveforms.exchange(false)) {
+    cm_msg(MINFO, "online_analyzer", "Processing a sis3302 event.");
+    plot_traces("sis3302", p_sis3302, SIS_3302_CH, 0, c1);
+  }
+
+  if (new_sis3316_waveforms.exchange(false)) {
+    cm_msg(MINFO, "online_analyzer", "Processing a sis3316 event.");
+    plot_traces("sis3316", p_sis3316, SIS_3316_CH, 1, c1);
+  }
+
+  // The averages change slowly, so they are drawn less often.
+  static auto last_spectra = std::chrono::steady_clock::time_point();
+  double interval = params.Double("/Params/spectrum/plot-interval-s", 5.0);
+  auto now = std::chrono::steady_clock::now();
+
+  if (std::chrono::duration<double>(now - last_spectra).count() > interval) {
+    plot_spectra("sis3302", *sis3302_spectra, c1);
+    plot_spectra("sis3316", *sis3316_spectra, c1);
+
+    if (full_rate) {
+      plot_full_rate(c1);
+    }
+
+    last_spectra = now;
+  }
+
+  // Done with the trace buffers, the next event may refill them.
+  plot_pending = false;
+}
+
+// Plot the trace and FFT power of each channel, the number of samples
+// follows the data.  Channels are titled from first_ch.
+void plot_traces(const char *prefix, const std::vector<WORD>& traces,
+                 int num_ch, int first_ch, TCanvas& c1)
 {
   // We need these for each FID, so keep them allocated.
   static char title[32], name[32];
   static std::vector<double> wf;
   static std::vector<double> tm;
-  static TCanvas c1("c1", "Online Monitor", 360, 270);
-  static TH1F *ph_wfm = nullptr;
-  static TH1F *ph_fft = nullptr;
-
-  unsigned int ch, idx;
-  float *pfreq;
-
-  // Look for the first SIS3302 traces.
-  while (!time_for_breakdown) {
-
-    if (new_sis3302_waveforms) {
-      
-      cm_msg(MINFO, "online_analyzer", "Processing a sis3302 event.");
-      
-      wf.resize(SIS_3302_LN);
-      tm.resize(SIS_3302_LN);
-      
-      // Set up the time vector.
-      for (idx = 0; idx < SIS_3302_LN; idx++){
-        tm[idx] = idx * 0.0001;  // @10 MHz, t = [0ms, 10ms]
+
+  trace_view view(traces.data(), traces.size(), num_ch);
+  int len = view.len();
+
+  if (!view) return;
+
+  wf.resize(len);
+  tm.resize(len);
+
+  // Set up the time vector, @10 MHz, t = [0ms, 10ms]
+  util::Ramp(len, 0.0, 0.0001, tm.data());
+
+  // Copy and analyze each channel's FID separately.
+  for (int ch = 0; ch < num_ch; ++ch) {
+
+    util::WidenU16(view.trace(ch), len, wf.data());
+    auto myfid = fid::FID(wf, tm);
+
+    const auto &fid_tm = myfid.tm();
+    const auto &freq = myfid.fftfreq();
+    const auto &power = myfid.power();
+
+    sprintf(name, "%s_ch%02i_wf", prefix, ch);
+    sprintf(title, "Channel %i Trace", ch + first_ch);
+    TH1F h_wfm(name, title, fid_tm.size(), fid_tm[0], fid_tm.back());
+
+    for (unsigned int idx = 0; idx < fid_tm.size(); ++idx) {
+      h_wfm.SetBinContent(idx + 1, myfid.wf()[idx]);
+    }
+
+    // The power has its own, shorter, binning.
+    sprintf(name, "%s_ch%02i_fft", prefix, ch);
+    sprintf(title, "Channel %i Fourier Transform", ch + first_ch);
+    TH1F h_fft(name, title, power.size(), freq[0], freq.back());
+
+    for (unsigned int idx = 0; idx < power.size(); ++idx) {
+      h_fft.SetBinContent(idx + 1, power[idx]);
+    }
+
+    c1.SetLogx(0);
+    c1.SetLogy(0);
+    h_wfm.Draw();
+    c1.Print(TString::Format("%s/%s.gif", figdir.c_str(), h_wfm.GetName()));
+
+    c1.SetLogx(1);
+    c1.SetLogy(1);
+    h_fft.Draw();
+    c1.Print(TString::Format("%s/%s.gif", figdir.c_str(), h_fft.GetName()));
+  }
+}
+
+// Draw the averaged power spectra and the spectrogram of each channel.
+void plot_spectra(const char *prefix, util::SpectrumAccumulator& spectra,
+                  TCanvas& c1)
+{
+  static char title[64], name[64];
+  static std::vector<double> exp_avg;
+  static std::vector<double> win_avg;
+  static std::vector<float> rows;
+
+  if (spectra.num_events() == 0) return;
+
+  const std::vector<double>& freq = spectra.freq();
+  int num_bins = spectra.num_bins();
+  double f0 = freq[0];
+  double f1 = freq[num_bins - 1];
+
+  for (int ch = 0; ch < spectra.num_ch(); ++ch) {
+
+    spectra.ExpAverage(ch, exp_avg);
+    spectra.WindowAverage(ch, win_avg);
+    int num_cols = 0;
+    int num_rows = spectra.Spectrogram(ch, rows, num_cols);
+
+    if (exp_avg.empty()) continue;
+
+    sprintf(name, "%s_ch%02i_fft_avg", prefix, ch);
+    sprintf(title, "Channel %i Averaged Power", ch);
+    TH1F h_exp(name, title, num_bins, f0, f1);
+    TH1F h_win("win_avg", title, num_bins, f0, f1);
+
+    for (int k = 0; k < num_bins; ++k) {
+      h_exp.SetBinContent(k + 1, exp_avg[k]);
+      h_win.SetBinContent(k + 1, win_avg[k]);
+    }
+
+    // Exponential in black, the last window in red.
+    h_win.SetLineColor(kRed);
+
+    c1.SetLogx(1);
+    c1.SetLogy(1);
+    c1.SetLogz(0);
+    h_exp.Draw();
+    h_win.Draw("same");
+    c1.Print(TString::Format("%s/%s.gif", figdir.c_str(), name));
+
+    if (num_rows == 0) continue;
+
+    // Newest row on top, y counts rows back in time.
+    sprintf(name, "%s_ch%02i_spectrogram", prefix, ch);
+    sprintf(title, "Channel %i Spectrogram", ch);
+    TH2F h_sg(name, title, num_cols, f0, f1, num_rows, -num_rows, 0);
+
+    for (int r = 0; r < num_rows; ++r) {
+      for (int c = 0; c < num_cols; ++c) {
+        h_sg.SetBinContent(c + 1, r + 1, rows[r * num_cols + c]);
       }
+    }
 
-      // Copy and analyze each channel's FID separately.
-      for (ch = 0; ch < SIS_3302_CH; ++ch) {
-
-        std::copy(&p_sis3302[ch][0], &p_sis3302[ch + 1][0], wf.begin());
-        auto myfid = fid::FID(wf, tm);
-        
-        sprintf(name, "sis3302_ch%02i_wf", ch);
-        sprintf(title, "Channel %i Trace", ch);
-        ph_wfm = new TH1F(name, title, SIS_3316_LN, myfid.tm()[0], 
-                          myfid.tm()[myfid.tm().size() - 1]);
-      
-        sprintf(name, "sis3302_ch%02i_fft", ch);
-        sprintf(title, "Channel %i Fourier Transform", ch);
-        ph_fft = new TH1F(name, title, SIS_3316_LN, myfid.fftfreq()[0], 
-                          myfid.fftfreq()[myfid.fftfreq().size() - 1]);
-        
-        // One histogram gets the waveform and another with the fft power.
-        for (idx = 0; idx < myfid.power().size(); ++idx){
-          ph_wfm->SetBinContent(idx, myfid.wf()[idx]);
-          ph_fft->SetBinContent(idx, myfid.power()[idx]);
-        }
-        
-        // The waveform has more samples.
-        for (; idx < SIS_3302_LN; ++idx) {
-          ph_wfm->SetBinContent(idx, myfid.wf()[idx]);
-        }
-        
-        c1.SetLogx(0);
-        c1.SetLogy(0);
-        ph_wfm->Draw();
-        c1.Print(TString::Format("%s/%s.gif", 
-                                 figdir.c_str(), 
-                                 ph_wfm->GetName()));
-        c1.SetLogx(1);
-        c1.SetLogy(1);
-        ph_fft->Draw();
-        c1.Print(TString::Format("%s/%s.gif", 
-                                 figdir.c_str(), 
-                                 ph_fft->GetName()));
-        
-        if (ph_wfm != nullptr) {
-          delete ph_wfm;
-        }
-        
-        if (ph_fft != nullptr) {
-          delete ph_fft;
-        }
+    c1.SetLogx(0);
+    c1.SetLogy(0);
+    c1.SetLogz(1);
+    h_sg.Draw("colz");
+    c1.Print(TString::Format("%s/%s.gif", figdir.c_str(), name));
+  }
+
+  c1.SetLogz(0);
+}
+
+// Merge the histograms of the full-rate workers and draw them.
+void plot_full_rate(TCanvas& c1)
+{
+  TH1F h_rate("full_rate_rate", "Events per Second;seconds ago;events",
+              kRateSeconds, -kRateSeconds, 0);
+  TH2F h_sis3302("sis3302_amplitude", "SIS3302 Amplitude;adc;channel",
+                 kAmpBins, 0, 65536, SIS_3302_CH, 0, SIS_3302_CH);
+  TH2F h_sis3316("sis3316_amplitude", "SIS3316 Amplitude;adc;channel",
+                 kAmpBins, 0, 65536, SIS_3316_CH, 0, SIS_3316_CH);
+  DWORD newest = 0;
+
+  for (int i = 0; i < num_workers; ++i) {
+    std::lock_guard<std::mutex> lock(worker_stats[i].mutex);
+
+    for (auto t : worker_stats[i].rate_time) {
+      newest = std::max(newest, t);
+    }
+  }
+
+  for (int i = 0; i < num_workers; ++i) {
+    full_rate_stats& stats = worker_stats[i];
+    std::lock_guard<std::mutex> lock(stats.mutex);
+
+    // The current second is still filling, so it is left out.
+    for (int idx = 0; idx < kRateSeconds; ++idx) {
+      DWORD age = newest - stats.rate_time[idx];
+
+      if (stats.rate_time[idx] != 0 && age > 0 && age <= kRateSeconds) {
+        h_rate.AddBinContent(kRateSeconds + 1 - age, stats.rate_count[idx]);
       }
     }
-    
-    if (new_sis3316_waveforms) {
-      // Look for the first SIS3316 traces.
-      cm_msg(MINFO, "online_analyzer", "Processing a sis3316 event.");
-      
-      wf.resize(SIS_3316_LN);
-      tm.resize(SIS_3316_LN);
-      
-      // Set up the time vector.
-      for (idx = 0; idx < SIS_3316_LN; idx++){
-        tm[idx] = idx * 0.0001;  // @10 MHz, t = [0ms, 10ms]
+
+    for (int ch = 0; ch < SIS_3302_CH; ++ch) {
+      for (int bin = 0; bin < kAmpBins; ++bin) {
+        h_sis3302.AddBinContent(h_sis3302.GetBin(bin + 1, ch + 1),
+                                stats.sis3302_amp[ch * kAmpBins + bin]);
       }
-      
-      // Copy and analyze each channel's FID separately.
-      for (ch = 0; ch < SIS_3316_CH; ++ch) {
-        
-        std::copy(&p_sis3316[ch][0], &p_sis3316[ch + 1][0], wf.begin());
-        
-        auto myfid = fid::FID(wf, tm);
-        
-        sprintf(name, "sis3316_ch%02i_wf", ch);
-        sprintf(title, "Channel %i Trace", ch + 1);
-        ph_wfm = new TH1F(name, title, SIS_3316_LN, myfid.tm()[0], 
-                          myfid.tm()[myfid.tm().size() - 1]);
-        
-        sprintf(name, "sis3316_ch%02i_fft", ch);
-        sprintf(title, "Channel %i Fourier Transform", ch + 1);
-        ph_fft = new TH1F(name, title, SIS_3316_LN, myfid.fftfreq()[0], 
-                          myfid.fftfreq()[myfid.fftfreq().size() - 1]);
-        
-        // One histogram gets the waveform and another with the fft power.
-        for (idx = 0; idx < myfid.power().size(); ++idx){
-          ph_wfm->SetBinContent(idx, myfid.wf()[idx]);
-          ph_fft->SetBinContent(idx, myfid.power()[idx]);
-        }
-        
-        // The waveform has more samples.
-        for (; idx < SIS_3316_LN; ++idx) {
-          ph_wfm->SetBinContent(idx, myfid.wf()[idx]);
-        }
-        
-        c1.SetLogx(0);
-        c1.SetLogy(0);
-        ph_wfm->Draw();
-        c1.Print(TString::Format("%s/%s.gif", figdir.c_str(), ph_wfm->GetName()));
-        
-        c1.SetLogx(1);
-        c1.SetLogy(1);
-        ph_fft->Draw();
-        c1.Print(TString::Format("%s/%s.gif", figdir.c_str(), ph_fft->GetName()));
-        
-        if (ph_wfm != nullptr) {
-          delete ph_wfm;
-        }
-        
-        if (ph_fft != nullptr) {
-          delete ph_fft;
-        }
+    }
+
+    for (int ch = 0; ch < SIS_3316_CH; ++ch) {
+      for (int bin = 0; bin < kAmpBins; ++bin) {
+        h_sis3316.AddBinContent(h_sis3316.GetBin(bin + 1, ch + 1),
+                                stats.sis3316_amp[ch * kAmpBins + bin]);
       }
     }
+  }
+
+  c1.SetLogx(0);
+  c1.SetLogy(0);
+  h_rate.Draw("hist");
+  c1.Print(TString::Format("%s/%s.gif", figdir.c_str(), h_rate.GetName()));
+
+  c1.SetLogz(1);
 
-    usleep(25000);
+  for (auto h : {&h_sis3302, &h_sis3316}) {
+    h->Draw("colz");
+    c1.Print(TString::Format("%s/%s.gif", figdir.c_str(), h->GetName()));
   }
+
+  c1.SetLogz(0);
+}
+
+// Averaging parameters, read at init and at each begin of run.
+util::spectrum_config spectrum_params()
+{
+  util::spectrum_config conf;
+
+  conf.alpha = params.Double("/Params/spectrum/alpha", conf.alpha);
+  conf.window = params.Int("/Params/spectrum/window", conf.window);
+  conf.rows = params.Int("/Params/spectrum/rows", conf.rows);
+  conf.row_events = params.Int("/Params/spectrum/row-events",
+                               conf.row_events);
+  conf.bins = params.Int("/Params/spectrum/bins", conf.bins);
+
+  return conf;
 }
 
 
 //-- Run Control Hooks -----------------------------------------------------//
 INT tr_stop_hook(INT run_number, char *error) 
 {
-  // Set the data merger info.
-  atomic_run_number = run_number;
-  new_run_to_process = true;
-  new_config_to_archive = true;
-  
+  // Queue the stop work of this run.  It keeps its own run number and
+  // the run log fields as they are now, so a quick restart can't
+  // redirect it.
+  util::run_entry entry = stop_entry(run_number);
+
+  post_run_job("merge", run_number, merge_data);
+  post_run_job("archive", run_number, [entry](int) {
+      return archive_config(entry);
+    });
+
   return CM_SUCCESS;
 }
 
-
-//-- Run Control Hooks -----------------------------------------------------//
-void merge_data_loop()
+// Queue one stop job and track it from queued to done in the ODB.
+void post_run_job(const char *name, int run_number,
+                  const std::function<bool(int)>& job)
 {
-  //DATA part
-  HNDLE hDB, hkey;
-  INT status;
-  char str[256], filename[256];
-  int size, run_number;
-
-  TFile *pf_sis3302;
-  TFile *pf_sis3316;
-  TFile *pf_final;
-
-  TTree *pt_old_sis3302;
-  TTree *pt_old_sis3316;
-  TTree *pt_sis3302;
-  TTree *pt_sis3316;
-    
-  cm_get_experiment_database(&hDB, NULL);
-  db_find_key(hDB, 0, "/Logger/Data dir", &hkey);
-    
-  if (hkey) {
-    size = sizeof(str);
-    db_get_data(hDB, hkey, str, &size, TID_STRING);
-    if (str[strlen(str) - 1] != DIR_SEPARATOR) {
-      strcat(str, DIR_SEPARATOR_STR);
-    }
-  }
-
-  while (!time_for_breakdown) {
-    
-    run_number = atomic_run_number;
-
-    if (new_run_to_process) {
-      // Open all the files.
-      sprintf(filename, "%sfe_sis3302_run_%05i.root", str, run_number);
-      pf_sis3302 = new TFile(filename);
-      if (!pf_sis3302->IsZombie()) {
-        pt_old_sis3302 = (TTree *)pf_sis3302->Get("t_sis3302");
-        std::cout << "Opened sis3302 file.\n";
-      } else {
-        std::cout << "Failed to open sis3302 file.\n";
+  auto t_stop = std::chrono::steady_clock::now();
+  char label[64];
+  sprintf(label, "%s %05i", name, run_number);
+  std::string job_name(label);
+
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    jobs_queued++;
+    jobs_left[run_number]++;
+  }
+
+  update_jobs("");
+
+  run_jobs.Post([name, run_number, job, job_name, t_stop] {
+      using namespace std::chrono;
+
+      auto t_start = steady_clock::now();
+
+      {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        jobs_queued--;
+        jobs_running++;
+        jobs_active.insert(job_name);
       }
 
-      sprintf(filename, "%s/fe_sis3316_run_%05i.root", str, run_number);
-      pf_sis3316 = new TFile(filename);
-      if (!pf_sis3316->IsZombie()) {
-        pt_old_sis3316 = (TTree *)pf_sis3316->Get("t_sis3316");
-        std::cout << "Opened sis3316 file.\n";
-      } else {
-        std::cout << "Failed to open sis3316 file.\n";
+      update_jobs("");
+
+      bool ok = job(run_number);
+
+      auto t_done = steady_clock::now();
+      double wait_ms = duration<double, std::milli>(t_start - t_stop).count();
+      double run_ms = duration<double, std::milli>(t_done - t_start).count();
+      bool run_ready = false;
+
+      {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        jobs_running--;
+
+        if (--jobs_left[run_number] == 0) {
+          jobs_left.erase(run_number);
+          run_ready = true;
+        }
+
+        if (ok) {
+          jobs_done++;
+        } else {
+          jobs_failed++;
+        }
+
+        jobs_active.erase(job_name);
       }
 
-      sprintf(filename, "%s/run_%05i.root", str, run_number);
-      pf_final = new TFile(filename, "recreate");
+      // MINFO and MERROR expand to several arguments, so no ?: on them.
+      cm_msg(ok ? MT_INFO : MT_ERROR, __FILE__, __LINE__, "online_analyzer",
+             "%s of run %i %s, "
+             "started %.1f ms after the stop and took %.1f ms", name,
+             run_number, ok ? "done" : "failed", wait_ms, run_ms);
 
-      // Copy the trees from the other two and remove them.
-      pt_sis3302 = pt_old_sis3302->CloneTree();
-      pt_sis3316 = pt_old_sis3316->CloneTree();
+      HNDLE hDB;
+      char key[128];
+      cm_get_experiment_database(&hDB, NULL);
 
-      pt_sis3302->Print();
-      pt_sis3316->Print();
+      sprintf(key, "/Equipment/online-monitor/Metrics/%s-wait-ms", name);
+      db_set_value(hDB, 0, key, &wait_ms, sizeof(wait_ms), 1, TID_DOUBLE);
 
-      pf_final->Write();
+      sprintf(key, "/Equipment/online-monitor/Metrics/%s-ms", name);
+      db_set_value(hDB, 0, key, &run_ms, sizeof(run_ms), 1, TID_DOUBLE);
 
-      delete pf_final;
-      delete pf_sis3302;
-      delete pf_sis3316;
+      // The last job of a run marks its files ready.
+      if (run_ready) {
+        double ready_ms = duration<double, std::milli>(t_done - t_stop).count();
 
-      // Make sure the file was written and clean up.
-      pf_final = new TFile(filename);
-  
-      if (!pf_final->IsZombie()) {
-        char cmd[256];
-        sprintf(cmd, "rm %s/fe_sis33*_run_%05i.root", str, run_number);
-        system(cmd);
+        cm_msg(MINFO, "online_analyzer", "run %i ready %.1f ms after the "
+               "stop", run_number, ready_ms);
+        db_set_value(hDB, 0, "/Equipment/online-monitor/Metrics/"
+                     "stop-to-ready-ms", &ready_ms, sizeof(ready_ms), 1,
+                     TID_DOUBLE);
       }
-    
-      delete pf_final;
 
-      ::new_run_to_process = false;
-    }
-    
-    usleep(100000);
+      update_jobs(job_name + (ok ? " done" : " failed"));
+    });
+}
+
+// Write the job counters, the running jobs and the last one to finish.
+void update_jobs(const std::string& last)
+{
+  HNDLE hDB, hkey;
+  std::string active;
+
+  cm_get_experiment_database(&hDB, NULL);
+  std::lock_guard<std::mutex> lock(jobs_mutex);
+
+  for (auto &job : jobs_active) {
+    active += (active.empty() ? "" : ", ") + job;
+  }
+
+  db_set_value(hDB, 0, "/Equipment/online-monitor/Jobs/queued",
+               &jobs_queued, sizeof(jobs_queued), 1, TID_INT);
+  db_set_value(hDB, 0, "/Equipment/online-monitor/Jobs/running",
+               &jobs_running, sizeof(jobs_running), 1, TID_INT);
+  db_set_value(hDB, 0, "/Equipment/online-monitor/Jobs/done",
+               &jobs_done, sizeof(jobs_done), 1, TID_INT);
+  db_set_value(hDB, 0, "/Equipment/online-monitor/Jobs/failed",
+               &jobs_failed, sizeof(jobs_failed), 1, TID_INT);
+  db_set_value(hDB, 0, "/Equipment/online-monitor/Jobs/active",
+               active.c_str(), active.size() + 1, 1, TID_STRING);
+
+  if (!last.empty()) {
+    db_set_value(hDB, 0, "/Equipment/online-monitor/Jobs/last",
+                 last.c_str(), last.size() + 1, 1, TID_STRING);
   }
 }
 
 
-void archive_config_loop()
+//-- Run Control Hooks -----------------------------------------------------//
+
+// Where the merged file of a run ends up, moved files live in the archive.
+std::string merged_path(int run_number)
 {
-  using namespace boost::property_tree;
+  char name[64];
+  sprintf(name, "run_%05i.root", run_number);
 
+  std::string mode = params.String("/Params/run-jobs/archive-mode", "none");
+
+  if (util::ParseArchiveMode(mode) == util::kArchiveMove) {
+    return params.Dir("/Params/run-jobs/archive-dir") + name;
+  }
+
+  return params.Dir("/Logger/Data dir") + name;
+}
+
+bool merge_data(int run_number)
+{
   //DATA part
-  HNDLE hDB, hkey;
-  INT status;
-  char str[256], filename[256];
-  int size, run_number;
-  std::string histdir;
-  std::string confdir;
-  std::string logdir;
+  char filename[256];
 
-  cm_get_experiment_database(&hDB, NULL);
+  std::string datadir = params.Dir("/Logger/Data dir");
+  const char *str = datadir.c_str();
 
-  // Get the history directory.
-  db_find_key(hDB, 0, "/Logger/History dir", &hkey);
-  if (hkey) {
-    size = sizeof(str);
-    db_get_data(hDB, hkey, str, &size, TID_STRING);
-    if (str[strlen(str) - 1] != DIR_SEPARATOR) {
-      strcat(str, DIR_SEPARATOR_STR);
+  // The frontend files of the run and the entries of their trees.
+  std::vector<std::string> sources;
+  std::vector<TFile *> files;
+  std::map<std::string, long long> entries;
+
+  sprintf(filename, "%srun_%05i.root", str, run_number);
+  std::string merged(filename);
+
+  for (std::string fe : {"sis3302", "sis3316"}) {
+    sprintf(filename, "%sfe_%s_run_%05i.root", str, fe.c_str(), run_number);
+
+    if (access(filename, F_OK) == 0) {
+      sources.push_back(std::string(filename));
     }
   }
 
-  histdir = std::string(str);
+  // fe_sis33xx writes the run file itself with an entry in both trees
+  // for every trigger, that only needs checking.
+  if (sources.empty() && access(merged.c_str(), F_OK) == 0) {
+    TFile *pf = new TFile(merged.c_str());
 
-  // Get the log directory.
-  db_find_key(hDB, 0, "/Logger/Log Dir", &hkey);
-  if (hkey) {
-    size = sizeof(str);
-    db_get_data(hDB, hkey, str, &size, TID_STRING);
-    if (str[strlen(str) - 1] != DIR_SEPARATOR) {
-      strcat(str, DIR_SEPARATOR_STR);
+    for (std::string tree : {"t_sis3302", "t_sis3316"}) {
+      TTree *pt = nullptr;
+
+      if (!pf->IsZombie()) {
+        pt = (TTree *)pf->Get(tree.c_str());
+      }
+
+      if (pt != nullptr) {
+        entries[tree] = pt->GetEntries();
+      }
     }
-  }
 
-  logdir = std::string(str);
+    delete pf;
 
-  // Get the config directory.
-  db_find_key(hDB, 0, "/Params/config-dir", &hkey);
-  if (hkey) {
-    size = sizeof(str);
-    db_get_data(hDB, hkey, str, &size, TID_STRING);
-    if (str[strlen(str) - 1] != DIR_SEPARATOR) {
-      strcat(str, DIR_SEPARATOR_STR);
+    if (entries.size() != 2 ||
+        entries["t_sis3302"] != entries["t_sis3316"]) {
+      cm_msg(MERROR, "online_analyzer", "run %i file from fe_sis33xx is "
+             "incomplete, %lli and %lli entries", run_number,
+             entries["t_sis3302"], entries["t_sis3316"]);
+      return false;
     }
+
+    return check_run_file(run_number, merged, entries, sources);
   }
 
-  confdir = std::string(str);
+  sources.clear();
+  TFile *pf_final = new TFile(merged.c_str(), "recreate");
 
-  while (!time_for_breakdown) {
-    
-    run_number = atomic_run_number;
+  for (std::string fe : {"sis3302", "sis3316"}) {
+    sprintf(filename, "%sfe_%s_run_%05i.root", str, fe.c_str(), run_number);
+    TFile *pf = new TFile(filename);
+    TTree *pt = nullptr;
 
-    if (new_config_to_archive) {
+    if (!pf->IsZombie()) {
+      pt = (TTree *)pf->Get(("t_" + fe).c_str());
+    }
 
-      sprintf(str, "%srun%05d_config.json", histdir.c_str(), run_number);
-      std::string conf_archive(str);
-      std::string conf_file;
-      std::string str1;
+    if (pt != nullptr) {
+      pf_final->cd();
+      pt->CloneTree()->Print();
+      entries[pt->GetName()] = pt->GetEntries();
+      sources.push_back(std::string(filename));
 
-      ptree pt_archive;
-      ptree pt_temp;
+    } else {
+      std::cout << "Failed to open " << fe << " file.\n";
+    }
 
-      // Open all the files.
-      db_find_key(hDB, 0, "/Params/config-file/fe-sis3302", &hkey);
-      if (hkey) {
-        size = sizeof(str);
-        db_get_data(hDB, hkey, str, &size, TID_STRING);
+    files.push_back(pf);
+  }
 
-        conf_file = confdir + std::string(str);
-        read_json(conf_file, pt_temp);
+  pf_final->Write();
+  delete pf_final;
 
-        pt_archive.put_child("fe_sis3302", pt_temp);
-      }
+  for (auto pf : files) {
+    delete pf;
+  }
+
+  if (sources.empty()) {
+    cm_msg(MERROR, "online_analyzer", "no frontend ROOT files for run %i",
+           run_number);
+    unlink(merged.c_str());
+    return false;
+  }
 
-      // Open all the files.
-      db_find_key(hDB, 0, "/Params/config-file/fe-sis3316", &hkey);
-      if (hkey) {
-        size = sizeof(str);
-        db_get_data(hDB, hkey, str, &size, TID_STRING);
+  return check_run_file(run_number, merged, entries, sources);
+}
 
-        conf_file = confdir + std::string(str);
-        read_json(conf_file, pt_temp);
+// Check the trees of the run file against the expected entries,
+// checksum it, then drop its sources and archive it.
+bool check_run_file(int run_number, const std::string& merged,
+                    const std::map<std::string, long long>& entries,
+                    const std::vector<std::string>& sources)
+{
+  // Check the merged trees and checksum the file at the same time.
+  auto count_check = std::async(std::launch::async, [&] {
+      TFile f(merged.c_str());
+      std::string bad;
 
-        pt_archive.put_child("fe_sis3316", pt_temp);
-      }
+      for (auto &tree : entries) {
+        TTree *pt = nullptr;
 
-      // Now go through all the keys, and add the ones that are json files.
-      std::vector<std::string> keys;
-
-      // Get the keys first, otherwise it iterates over added keys too.
-      for (auto &kv : pt_archive)
-        keys.push_back(kv.first);
-
-      // Check the devices for each front-end.
-      for (auto &key : keys) {
-
-        for (auto &val : pt_archive.get_child(key).get_child("devices")) {
-
-          for (auto &val2 : val.second) {
-
-            try {
-              str1 = std::string(val2.second.data());
-              
-            } catch (...) {
-              
-              continue;
-            }
-
-            if (str1.find("json") != std::string::npos) {
-              
-              conf_file = confdir + str1;
-              read_json(conf_file, pt_temp);
-              
-              pt_archive.put_child(val2.first, pt_temp);
-              
-            }
-          }
+        if (!f.IsZombie()) {
+          pt = (TTree *)f.Get(tree.first.c_str());
         }
-        
-        // And all the other first level keys.
-        for (auto &val : pt_archive.get_child(key)) {
-          
-          try {
-            str1 = std::string(val.second.data());
-
-          } catch (...) {
-
-            continue;
-          }
-
-          if (str1.find("json") != std::string::npos) {
-            
-            conf_file = confdir + str1;
-            read_json(conf_file, pt_temp);
-          
-            pt_archive.put_child(val.first, pt_temp);
-          }
+
+        if (pt == nullptr || pt->GetEntries() != tree.second) {
+          bad += " " + tree.first;
         }
       }
 
-      // Write out the archive of config data.
-      write_json(conf_archive, pt_archive, std::locale(), false);
+      return bad;
+    });
 
-      // Now take care of the runlog file with Comments and tags.
-      ptree pt_runlog;
-      ptree pt_run;
-      std::string runlog_file = logdir + "runlog.json";
+  unsigned long crc = 0;
+  auto crc_check = std::async(std::launch::async, [&] {
+      return util::FileCrc32(merged, crc);
+    });
 
-      try {
-        read_json(runlog_file, pt_runlog);
+  std::string bad = count_check.get();
+  bool crc_ok = crc_check.get();
 
-      } catch (...) {}
+  if (!bad.empty() || !crc_ok) {
+    cm_msg(MERROR, "online_analyzer", "run %i merge check failed:%s%s, "
+           "keeping the frontend files", run_number, bad.c_str(),
+           crc_ok ? "" : " unreadable");
+    return false;
+  }
 
-      // Get the comment from the ODB
-      db_find_key(hDB, 0, "/Experiment/Run Parameters/Comment", &hkey);
-      if (hkey) {
-        size = sizeof(str);
-        db_get_data(hDB, hkey, str, &size, TID_STRING);
+  if (!util::WriteCrc32File(merged, crc)) {
+    cm_msg(MERROR, "online_analyzer", "run %i: failed to write %s.crc32, "
+           "keeping the frontend files", run_number, merged.c_str());
+    return false;
+  }
 
-        pt_run.put("comment", std::string(str));
-      }
-  
+  std::string error;
 
-      // Get the comment from the ODB
-      db_find_key(hDB, 0, "/Experiment/Run Parameters/Tags", &hkey);
-      if (hkey) {
-        size = sizeof(str);
-        db_get_data(hDB, hkey, str, &size, TID_STRING);
-    
-        ptree pt_tags;
-        std::string tag;
-        std::istringstream ss(str);
-        while (std::getline(ss, tag, ',')) {
-          ptree pt_tag;
-          pt_tag.put("", tag);
-          pt_tags.push_back(std::make_pair("", pt_tag));
-        }
-    
-        pt_run.put_child("tags", pt_tags);
+  if (!util::RemoveFiles(sources, error)) {
+    cm_msg(MERROR, "online_analyzer", "run %i: failed to remove %s",
+           run_number, error.c_str());
+  }
+
+  // Optionally hand the file and its checksum to archival storage.
+  util::archive_mode mode = util::ParseArchiveMode(
+    params.String("/Params/run-jobs/archive-mode", "none"));
+  std::string archive_dir = params.Dir("/Params/run-jobs/archive-dir");
+
+  if (mode != util::kArchiveNone) {
+    for (auto &path : {merged, merged + ".crc32"}) {
+      if (util::ArchiveFile(path, archive_dir, mode, error).empty()) {
+        cm_msg(MERROR, "online_analyzer", "run %i: failed to archive %s",
+               run_number, error.c_str());
+        return false;
       }
-  
-      sprintf(str, "run_%05d", run_number);
-      pt_runlog.put_child(std::string(str), pt_run);
+    }
+  }
+
+  cm_msg(MINFO, "online_analyzer", "%s run %i, crc32 %08lx",
+         sources.empty() ? "checked" : "merged", run_number, crc);
+
+  return true;
+}
+
+
+// Open the run log, importing an old runlog.json the first time.
+util::RunLog &open_run_log(const std::string& logdir)
+{
+  static util::RunLog run_log;
+
+  if (run_log.Open(logdir + "runlog.sqlite")) {
+    int num_runs = run_log.ImportJson(logdir + "runlog.json");
 
-      write_json(runlog_file, pt_runlog, std::locale(), true);
+    if (num_runs > 0) {
+      cm_msg(MINFO, "online_analyzer", "imported %i runs from runlog.json",
+             num_runs);
+      rename((logdir + "runlog.json").c_str(),
+             (logdir + "runlog.json.imported").c_str());
+    }
+
+  } else {
+    cm_msg(MERROR, "online_analyzer", "could not open %srunlog.sqlite: %s",
+           logdir.c_str(), run_log.error().c_str());
+  }
+
+  return run_log;
+}
+
+// The run log fields that come from the ODB, read in the stop hook so
+// the job gets them even if the next run has already started.
+util::run_entry stop_entry(int run_number)
+{
+  HNDLE hDB, hkey;
+  char str[256];
+  int size;
+
+  cm_get_experiment_database(&hDB, NULL);
+
+  util::run_entry entry;
+  entry.run = run_number;
+
+  size = sizeof(str);
+  str[0] = 0;
+  db_get_value(hDB, 0, "/Runinfo/Start time", str, &size, TID_STRING, FALSE);
+  entry.start_time = std::string(str);
+
+  size = sizeof(str);
+  str[0] = 0;
+  db_get_value(hDB, 0, "/Runinfo/Stop time", str, &size, TID_STRING, FALSE);
+  entry.stop_time = std::string(str);
+
+  // Events of the frontend that took the run, the other one's counter
+  // is left over from whenever it last ran.  The combined frontend
+  // sends one event per trigger.
+  std::string fe_name = "fe-sis3302";
+
+  if (cm_exist("fe-sis33xx", FALSE) == CM_SUCCESS) {
+    fe_name = "fe-sis33xx";
+  }
+
+  double events = 0;
+  size = sizeof(events);
+  db_get_value(hDB, 0, ("/Equipment/" + fe_name +
+                        "/Statistics/Events sent").c_str(),
+               &events, &size, TID_DOUBLE, FALSE);
+
+  entry.events = events;
+
+  // Comment and tags of the run from the ODB.
+  entry.comment = params.String("/Experiment/Run Parameters/Comment");
+  entry.tags = util::SplitTags(
+    params.String("/Experiment/Run Parameters/Tags"));
+
+  DWORD t_binary = 0;
+  size = sizeof(t_binary);
+  db_get_value(hDB, 0, "/Runinfo/Start time binary", &t_binary, &size,
+               TID_DWORD, FALSE);
+  entry.start_unix = t_binary;
+
+  t_binary = 0;
+  size = sizeof(t_binary);
+  db_get_value(hDB, 0, "/Runinfo/Stop time binary", &t_binary, &size,
+               TID_DWORD, FALSE);
+  entry.stop_unix = t_binary;
 
-      // Close the loop
-      ::new_config_to_archive = false;
+  return entry;
+}
+
+bool archive_config(util::run_entry entry)
+{
+  using namespace boost::property_tree;
+
+  //DATA part
+  char str[256];
+
+  std::string histdir = params.Dir("/Logger/History dir");
+  std::string datadir = params.Dir("/Logger/Data dir");
+  std::string confdir = params.Dir("/Params/config-dir");
+
+  // The store and the run log keep their caches between runs, and are
+  // used by one archive job at a time.
+  static std::mutex archive_mutex;
+  std::lock_guard<std::mutex> lock(archive_mutex);
+
+  static util::ConfigStore config_store(histdir + "config-store");
+  static util::RunLog &run_log = open_run_log(params.Dir("/Logger/Log Dir"));
+
+  int run_number = entry.run;
+  sprintf(str, "%srun%05d_config.json", histdir.c_str(), run_number);
+  std::string conf_archive(str);
+
+  // The configs go in the store once, the run gets a manifest.
+  ptree pt_archive;
+
+  for (std::string fe : {"fe-sis3302", "fe-sis3316", "fe-sis33xx"}) {
+    std::string file = params.String("/Params/config-file/" + fe);
+
+    if (!file.empty()) {
+      std::replace(fe.begin(), fe.end(), '-', '_');
+      config_store.Archive(fe, confdir, file, pt_archive);
+    }
+  }
+
+  // Write out the manifest of config data.
+  write_json(conf_archive, pt_archive, std::locale(), false);
+
+  // Now add the run to the run log, the rest was read at the stop.
+  entry.config = conf_archive;
+
+  // The merged ROOT file and whatever the logger wrote for the run.
+  entry.files.push_back(merged_path(run_number));
+
+  glob_t midas_files;
+  sprintf(str, "%srun%05d*", datadir.c_str(), run_number);
+
+  if (glob(str, 0, NULL, &midas_files) == 0) {
+    for (size_t i = 0; i < midas_files.gl_pathc; ++i) {
+      entry.files.push_back(std::string(midas_files.gl_pathv[i]));
     }
+  }
+
+  globfree(&midas_files);
 
-    usleep(100000);
+  if (!run_log.Append(entry)) {
+    cm_msg(MERROR, "online_analyzer", "failed to log run %i: %s",
+           run_number, run_log.error().c_str());
+    return false;
   }
+
+  return true;
 }
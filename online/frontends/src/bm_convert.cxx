@@ -0,0 +1,98 @@
+/*---------------------------------------------------------------------------*\
+file:   bm_convert.cxx
+
+about:  Microbenchmark of the sample conversion kernels.  Converts a
+        board's worth of traces over and over with the scalar and the
+        AVX2 kernels and reports GB/s of doubles written, and checks
+        that both give the same result.
+
+usage:  bm_convert [samples] [repeats]
+
+\*---------------------------------------------------------------------------*/
+
+//-- std includes ------------------------------------------------------------//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <functional>
+
+//--- project includes -------------------------------------------------------//
+#include "util/convert.hh"
+
+double Time(const std::function<void()>& f, int repeats)
+{
+  f();  // warm up the caches
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < repeats; ++i) {
+    f();
+  }
+
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+int main(int argc, char **argv)
+{
+  size_t n = (argc > 1) ? atol(argv[1]) : 16 * 1024;
+  int repeats = (argc > 2) ? atoi(argv[2]) : 20000;
+
+  std::mt19937 gen(42);
+  std::vector<uint16_t> samples(n);
+  std::vector<char> bytes(2 * n);
+
+  for (auto &x : samples) x = gen();
+  for (auto &x : bytes) x = gen();
+
+  std::vector<double> out(n);
+  std::vector<double> ref(n);
+
+  struct kernel {
+    const char *name;
+    std::function<void(double *)> run;
+  };
+
+  std::vector<kernel> kernels = {
+    {"widen u16", [&](double *dst) {
+        util::WidenU16(samples.data(), n, dst); }},
+    {"scale u16", [&](double *dst) {
+        util::ScaleU16(samples.data(), n, 0.25, -100.0, dst); }},
+    {"scale i16 le", [&](double *dst) {
+        util::ScaleI16Bytes(bytes.data(), n, false, 0.04, 0.0, dst); }},
+    {"scale i16 be", [&](double *dst) {
+        util::ScaleI16Bytes(bytes.data(), n, true, 0.04, 0.0, dst); }},
+    {"ramp", [&](double *dst) {
+        util::Ramp(n, 1.5, 0.0001, dst); }},
+  };
+
+  printf("%zu samples, %i repeats, default kernels %s\n", n, repeats,
+         util::ConvertIsa());
+
+  for (auto &k : kernels) {
+    for (auto isa : {"scalar", "avx2"}) {
+
+      if (!util::SetConvertIsa(isa)) {
+        printf("%-14s %-7s not supported on this cpu\n", k.name, isa);
+        continue;
+      }
+
+      double dt = Time([&] { k.run(out.data()); }, repeats);
+      double gb = (double)n * sizeof(double) * repeats * 1.0e-9;
+
+      if (strcmp(isa, "scalar") == 0) {
+        ref = out;
+        printf("%-14s %-7s %8.2f GB/s\n", k.name, isa, gb / dt);
+
+      } else {
+        printf("%-14s %-7s %8.2f GB/s %s\n", k.name, isa, gb / dt,
+               (out == ref) ? "" : "MISMATCH");
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+/*---------------------------------------------------------------------------*\
+file:   bm_mpmc_queue.cxx
+
+about:  Throughput of the lock-free MPMC queue against a mutex and a
+        deque, the way the full-rate online monitor uses it: slot
+        numbers cycle from a free queue to a full queue and back.  One
+        producer stands in for the analyzer loop, the consumers for the
+        workers.  Reports slots passed per second.
+
+usage:  bm_mpmc_queue [consumers] [slots] [seconds]
+
+\*---------------------------------------------------------------------------*/
+
+//-- std includes ------------------------------------------------------------//
+#include <stdio.h>
+#include <stdlib.h>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//--- project includes -------------------------------------------------------//
+#include "util/mpmc_queue.hh"
+
+// The same interface over a mutex, for comparison.
+class LockedQueue {
+ public:
+  explicit LockedQueue(size_t capacity) : capacity_(capacity) {};
+
+  bool TryPush(const int& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.size() == capacity_) return false;
+    queue_.push_back(value);
+    return true;
+  };
+
+  bool TryPop(int& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.empty()) return false;
+    value = queue_.front();
+    queue_.pop_front();
+    return true;
+  };
+
+ private:
+  size_t capacity_;
+  std::mutex mutex_;
+  std::deque<int> queue_;
+};
+
+template <typename Queue>
+double Run(int num_consumers, int num_slots, double seconds)
+{
+  Queue free_slots(num_slots);
+  Queue full_slots(num_slots);
+  std::atomic<bool> stop(false);
+  std::atomic<long long> passed(0);
+  std::vector<std::thread> consumers;
+
+  for (int i = 0; i < num_slots; ++i) {
+    free_slots.TryPush(i);
+  }
+
+  for (int i = 0; i < num_consumers; ++i) {
+    consumers.push_back(std::thread([&] {
+          long long n = 0;
+          int slot;
+
+          while (!stop) {
+            if (full_slots.TryPop(slot)) {
+              free_slots.TryPush(slot);
+              ++n;
+            } else {
+              std::this_thread::yield();
+            }
+          }
+
+          passed += n;
+        }));
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  auto t1 = t0;
+  int slot;
+
+  while (std::chrono::duration<double>(t1 - t0).count() < seconds) {
+    for (int i = 0; i < 1024; ++i) {
+      while (!free_slots.TryPop(slot)) {
+        std::this_thread::yield();
+      }
+
+      full_slots.TryPush(slot);
+    }
+
+    t1 = std::chrono::steady_clock::now();
+  }
+
+  stop = true;
+
+  for (auto &thread : consumers) {
+    thread.join();
+  }
+
+  return passed / std::chrono::duration<double>(t1 - t0).count();
+}
+
+int main(int argc, char **argv)
+{
+  int num_consumers = (argc > 1) ? atoi(argv[1]) : 4;
+  int num_slots = (argc > 2) ? atoi(argv[2]) : 64;
+  double seconds = (argc > 3) ? atof(argv[3]) : 2.0;
+
+  printf("1 producer, %i consumers, %i slots\n", num_consumers, num_slots);
+  printf("%-12s %12.3g slots/s\n", "mpmc",
+         Run<util::MpmcQueue<int>>(num_consumers, num_slots, seconds));
+  printf("%-12s %12.3g slots/s\n", "mutex+deque",
+         Run<LockedQueue>(num_consumers, num_slots, seconds));
+
+  return 0;
+}
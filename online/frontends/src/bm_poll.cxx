@@ -0,0 +1,121 @@
+/*---------------------------------------------------------------------------*\
+file:   bm_poll.cxx
+
+about:  CPU cost and detection latency of the poll_event strategies.  A
+        thread posts events at random times at a given mean rate, the
+        poller waits for them the way the SIS frontends do, and the
+        true delay from posting to detection is measured along with the
+        CPU time the polling thread used.  Compares checking in a tight
+        loop, the old behaviour, against the adaptive poller.  A rate
+        of 0 posts nothing, every wait should then end with the 25 ms
+        window.
+
+usage:  bm_poll [seconds per rate] [rate ...]
+
+\*---------------------------------------------------------------------------*/
+
+//-- std includes ------------------------------------------------------------//
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+//--- project includes -------------------------------------------------------//
+#include "util/adaptive_poll.hh"
+
+typedef std::chrono::steady_clock steady;
+
+double ThreadCpuSeconds()
+{
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+void Run(const char *label, bool adaptive, double rate, double seconds)
+{
+  std::atomic<long long> posted_ns(0);  // post time of the pending event
+  std::atomic<bool> stop(false);
+
+  std::thread producer([&] {
+      std::mt19937 gen(42);
+      std::exponential_distribution<double> gap(rate > 0.0 ? rate : 1.0);
+      auto t0 = steady::now();
+
+      while (!stop) {
+        if (rate <= 0.0) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          continue;
+        }
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(gap(gen)));
+
+        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            steady::now() - t0).count();
+        long long none = 0;
+
+        // Drop the event if the last one has not been seen yet.
+        posted_ns.compare_exchange_strong(none, ns);
+      }
+    });
+
+  util::AdaptivePoller poller;
+  util::poll_policy policy;
+  policy.adaptive = adaptive;
+  poller.set_policy(policy);
+
+  util::JitterMonitor delay(1.0, 20000);
+  auto t0 = steady::now();
+  double cpu0 = ThreadCpuSeconds();
+  double longest_ms = 0.0;
+
+  // The producer's clock starts a hair later, close enough at us scale.
+  while (std::chrono::duration<double>(steady::now() - t0).count() < seconds) {
+    auto w0 = steady::now();
+    bool seen = poller.Wait([&] { return posted_ns.load() != 0; });
+    longest_ms = std::max(longest_ms, std::chrono::duration<double, std::milli>(
+                            steady::now() - w0).count());
+
+    if (seen) {
+      long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          steady::now() - t0).count();
+      delay.Fill(std::max(ns - posted_ns.exchange(0), 0LL) * 1.0e-3);
+    }
+  }
+
+  double cpu = ThreadCpuSeconds() - cpu0;
+
+  stop = true;
+  producer.join();
+
+  printf("%-10s %8.0f Hz %8llu events %6.1f%% cpu  delay p50 %7.1f us "
+         "p99 %8.1f us  longest wait %5.1f ms\n", label, rate,
+         delay.count(), 100.0 * cpu / seconds, delay.Percentile(0.5),
+         delay.Percentile(0.99), longest_ms);
+}
+
+int main(int argc, char **argv)
+{
+  double seconds = (argc > 1) ? atof(argv[1]) : 5.0;
+  std::vector<double> rates;
+
+  for (int i = 2; i < argc; ++i) {
+    rates.push_back(atof(argv[i]));
+  }
+
+  if (rates.empty()) {
+    rates = {0.0, 10.0, 100.0, 1000.0, 10000.0};
+  }
+
+  for (auto rate : rates) {
+    Run("spin", false, rate, seconds);
+    Run("adaptive", true, rate, seconds);
+  }
+
+  return 0;
+}
@@ -0,0 +1,117 @@
+/*---------------------------------------------------------------------------*\
+file:   bm_root_read.cxx
+
+about:  Read-throughput benchmark for the SIS ROOT output.  It scans a
+        tree three times, reading a whole board, the clocks only and a
+        single channel, and reports events/s and MB/s for each pass.
+        Works on both the leaflist and the split layouts.
+
+usage:  bm_root_read <file.root> [sis3316|sis3302] [board] [channel]
+
+\*---------------------------------------------------------------------------*/
+
+//-- std includes ------------------------------------------------------------//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <chrono>
+
+//--- other includes ---------------------------------------------------------//
+#include "TFile.h"
+#include "TTree.h"
+
+//--- project includes -------------------------------------------------------//
+#include "common.hh"
+#include "util/root_output.hh"
+
+typedef decltype(daq::event_data::sis_3316_vec)::value_type sis_3316_board;
+typedef decltype(daq::event_data::sis_3302_vec)::value_type sis_3302_board;
+
+template <typename T>
+void ScanTree(TFile *pf, TTree *t, const std::string& name, int channel,
+              bool with_clocks, const char *label)
+{
+  static T board;
+  double bytes = 0.0;
+  Long64_t zipped = pf->GetBytesRead();
+
+  t->SetBranchStatus("*", 0);
+
+  if (!util::SetBoardAddress(t, name, board, channel, with_clocks)) {
+    printf("board %s not found in tree %s\n", name.c_str(), t->GetName());
+    exit(1);
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  for (Long64_t i = 0; i < t->GetEntries(); ++i) {
+    bytes += t->GetEntry(i);
+  }
+
+  auto t1 = std::chrono::steady_clock::now();
+  double dt = std::chrono::duration<double>(t1 - t0).count();
+  zipped = pf->GetBytesRead() - zipped;
+
+  printf("%-14s %10.1f events/s %9.1f MB/s unzipped %9.1f MB/s from disk\n",
+         label, t->GetEntries() / dt, bytes / dt * 1.0e-6,
+         zipped / dt * 1.0e-6);
+
+  t->ResetBranchAddresses();
+}
+
+template <typename T>
+void RunScans(TFile *pf, TTree *t, const std::string& name, int channel)
+{
+  ScanTree<T>(pf, t, name, -1, true, "full board");
+  // No channel matches -2, with the leaflist layout this still reads all.
+  ScanTree<T>(pf, t, name, -2, true, "clocks only");
+  ScanTree<T>(pf, t, name, channel, false, "single channel");
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    printf("usage: %s <file.root> [sis3316|sis3302] [board] [channel]\n",
+           argv[0]);
+    return 1;
+  }
+
+  std::string device = (argc > 2) ? argv[2] : "sis3316";
+  int board = (argc > 3) ? atoi(argv[3]) : 0;
+  int channel = (argc > 4) ? atoi(argv[4]) : 0;
+
+  TFile *pf = new TFile(argv[1]);
+
+  if (pf->IsZombie()) {
+    printf("could not open %s\n", argv[1]);
+    return 1;
+  }
+
+  char name[64];
+  std::string tree_name = std::string("t_") + device;
+  TTree *t = (TTree *)pf->Get(tree_name.c_str());
+
+  if (t == nullptr) {
+    printf("no tree %s in %s\n", tree_name.c_str(), argv[1]);
+    return 1;
+  }
+
+  printf("%s: %lld entries, %s board %i channel %i\n", argv[1],
+         t->GetEntries(), device.c_str(), board, channel);
+
+  // Drop the OS cache between runs for cold numbers, i.e.
+  // sync; echo 3 > /proc/sys/vm/drop_caches
+  if (device == "sis3302") {
+    sprintf(name, "sis_3302_%i", board);
+    RunScans<sis_3302_board>(pf, t, name, channel);
+
+  } else {
+    sprintf(name, "sis_3316_%i", board);
+    RunScans<sis_3316_board>(pf, t, name, channel);
+  }
+
+  pf->Close();
+  delete pf;
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*---------------------------------------------------------------------------*\
+file:   bm_root_write.cxx
+
+about:  Write benchmark for the ROOT output settings under
+        /Params/root-compression.  A canned set of simulated SIS3316
+        events is written once per compression setting, reporting the
+        write throughput and the compression ratio of each.
+
+usage:  bm_root_write [events] [split|leaflist] [basket-size]
+                      [flush-bytes] [outdir]
+
+\*---------------------------------------------------------------------------*/
+
+//-- std includes ------------------------------------------------------------//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+//--- other includes ---------------------------------------------------------//
+#include "TFile.h"
+#include "TTree.h"
+
+//--- project includes -------------------------------------------------------//
+#include "common.hh"
+#include "util/root_output.hh"
+#include "util/fid_generator.hh"
+
+typedef decltype(daq::event_data::sis_3316_vec)::value_type sis_3316_board;
+
+// Number of distinct events generated, the rest are repeats.
+const int kCannedEvents = 64;
+
+int main(int argc, char **argv)
+{
+  int num_events = (argc > 1) ? atoi(argv[1]) : 1000;
+  std::string layout = (argc > 2) ? argv[2] : "split";
+  std::string outdir = (argc > 5) ? argv[5] : "/tmp";
+
+  util::root_output_config conf;
+  conf.basket_size = (argc > 3) ? atoi(argv[3]) : 0;
+  conf.flush_bytes = (argc > 4) ? atoi(argv[4]) : 32000000;
+  conf.autosave_bytes = 0;
+
+  // Generate the canned events up front so only writing is timed.
+  util::FidGenerator gen;
+  util::fid_config fid = util::DefaultFidConfig();
+  std::vector<sis_3316_board> canned(kCannedEvents);
+
+  for (auto &board : canned) {
+    board.system_clock = 0;
+
+    for (int ch = 0; ch < SIS_3316_CH; ++ch) {
+      board.device_clock[ch] = 0;
+      gen.Fill(&board.trace[ch][0], SIS_3316_LN, fid);
+    }
+  }
+
+  const char *algorithms[] = {"ZLIB", "ZLIB", "LZ4", "LZ4", "ZSTD", "ZSTD",
+                              "LZMA", "NONE"};
+  const int levels[] = {1, 6, 1, 4, 1, 5, 1, 0};
+  const int num_settings = sizeof(levels) / sizeof(levels[0]);
+
+  std::string filename = outdir + "/bm_root_write.root";
+  static sis_3316_board board;
+
+  printf("%i events of %.2f MB, %s layout, basket %i, flush %i bytes\n",
+         num_events, sizeof(board) * 1.0e-6, layout.c_str(),
+         conf.basket_size, conf.flush_bytes);
+  printf("%-6s %5s %10s %10s %8s\n", "algo", "level", "MB/s", "MB", "ratio");
+
+  for (int i = 0; i < num_settings; ++i) {
+
+    conf.algorithm = algorithms[i];
+    conf.level = levels[i];
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    TFile *pf = new TFile(filename.c_str(), "recreate", "",
+                          util::CompressionSettings(conf.algorithm,
+                                                    conf.level));
+    TTree *t = new TTree("t_sis3316", "SIS3316 Data");
+    util::SetFlushPolicy(t, conf);
+    util::BranchBoard(t, "sis_3316_0", board,
+                      util::ParseTraceLayout(layout), conf.basket_size);
+
+    for (int n = 0; n < num_events; ++n) {
+      board = canned[n % kCannedEvents];
+      board.system_clock = n;
+      t->Fill();
+    }
+
+    t->Write();
+    double tot_bytes = t->GetTotBytes();
+    double zip_bytes = t->GetZipBytes();
+    pf->Close();
+    delete pf;
+
+    auto t1 = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(t1 - t0).count();
+
+    printf("%-6s %5i %10.1f %10.1f %8.2f\n", conf.algorithm.c_str(),
+           conf.level, tot_bytes / dt * 1.0e-6, zip_bytes * 1.0e-6,
+           tot_bytes / zip_bytes);
+  }
+
+  unlink(filename.c_str());
+
+  return 0;
+}
@@ -0,0 +1,613 @@
+/********************************************************************\
+
+Name:   fe_replay.cxx
+
+About:  A frontend that re-injects recorded runs into the SYSTEM
+        buffer, so the analyzer, logger and merging can be load-tested
+        without digitizers.  It reads either a ROOT file written by the
+        SIS frontends (run_N.root or fe_sis33*_run_N.root) or a MIDAS
+        file (.mid or .mid.gz) and re-emits the digitizer banks at the
+        original timing, a fixed rate or as fast as possible.
+
+        /Params/replay/file   file to replay
+        /Params/replay/mode   "original", "fixed" or "afap"
+        /Params/replay/rate   events per second for "fixed"
+        /Params/replay/loop   start over at the end of the file
+
+\********************************************************************/
+
+//--- std includes -------------------------------------------------//
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+using std::string;
+
+//--- other includes -----------------------------------------------//
+#include "midas.h"
+#include "TFile.h"
+#include "TTree.h"
+
+//--- project includes ---------------------------------------------//
+#include "common.hh"
+#include "util/root_output.hh"
+
+
+//--- globals ------------------------------------------------------//
+
+extern "C" {
+
+  // The frontend name (client name) as seen by other MIDAS clients
+  char *frontend_name = (char*) "fe-replay";
+
+  // The frontend file name, don't change it.
+  char *frontend_file_name = (char*) __FILE__;
+
+  // frontend_loop is called periodically if this variable is TRUE
+  BOOL frontend_call_loop = FALSE;
+
+  // A frontend status page is displayed with this frequency in ms.
+  INT display_period = 1000;
+
+  // maximum event size produced by this frontend
+  INT max_event_size = 0x800000;
+
+  // maximum event size for fragmented events (EQ_FRAGMENTED)
+  INT max_event_size_frag = 0x1000000;
+
+  // buffer size to hold events
+  INT event_buffer_size = 0x8000000;
+
+  // Function declarations
+  INT frontend_init();
+  INT frontend_exit();
+  INT begin_of_run(INT run_number, char *error);
+  INT end_of_run(INT run_number, char *error);
+  INT pause_run(INT run_number, char *error);
+  INT resume_run(INT run_number, char *error);
+
+  INT frontend_loop();
+  INT read_trigger_event(char *pevent, INT off);
+  INT poll_event(INT source, INT count, BOOL test);
+  INT interrupt_configure(INT cmd, INT source, PTYPE adr);
+
+  // Equipment list
+
+  EQUIPMENT equipment[] =
+    {
+      {"fe-replay",     // equipment name
+       { 1, 0,          // event ID, trigger mask
+         "SYSTEM",      // event buffer
+         EQ_POLLED,     // equipment type
+         0,             // not used
+         "MIDAS",       // format
+         TRUE,          // enabled
+         RO_RUNNING,    // read only when running
+         1,             // poll for 1ms
+         0,             // stop run after this event limit
+         0,             // number of sub events
+         0,             // don't log history
+         "", "", "",
+       },
+       read_trigger_event,      // readout routine
+      },
+
+      {""}
+    };
+
+} //extern C
+
+RUNINFO runinfo;
+
+typedef decltype(daq::event_data::sis_3316_vec)::value_type sis_3316_board;
+typedef decltype(daq::event_data::sis_3302_vec)::value_type sis_3302_board;
+
+//--- Replay sources -----------------------------------------------//
+
+namespace {
+
+// Banks left out because they were corrupt or didn't fit the event.
+unsigned long long banks_skipped = 0;
+
+class ReplaySource {
+ public:
+  virtual ~ReplaySource() {};
+
+  // Load the next event, false at the end of the file.
+  virtual bool Next() = 0;
+
+  // Timestamp of the loaded event in seconds.
+  virtual double Time() = 0;
+
+  // Append the digitizer banks of the loaded event.
+  virtual void WriteBanks(char *pevent) = 0;
+
+  virtual void Rewind() = 0;
+};
+
+// Replays the trees written by the SIS frontends.
+class RootSource : public ReplaySource {
+ public:
+  RootSource(const string& filename) : entry_(-1) {
+    pf_ = new TFile(filename.c_str());
+    t_sis3316_ = (TTree *)pf_->Get("t_sis3316");
+    t_sis3302_ = (TTree *)pf_->Get("t_sis3302");
+
+    Bind(t_sis3316_, "sis_3316_%i", sis_3316_vec_);
+    Bind(t_sis3302_, "sis_3302_%i", sis_3302_vec_);
+  };
+
+  ~RootSource() {
+    pf_->Close();
+    delete pf_;
+  };
+
+  bool Next() {
+    entry_++;
+    bool more = false;
+
+    if (t_sis3316_ != nullptr && entry_ < t_sis3316_->GetEntries()) {
+      t_sis3316_->GetEntry(entry_);
+      more = true;
+    }
+
+    if (t_sis3302_ != nullptr && entry_ < t_sis3302_->GetEntries()) {
+      t_sis3302_->GetEntry(entry_);
+      more = true;
+    }
+
+    return more;
+  };
+
+  // The system clock is in microseconds.
+  double Time() {
+    if (sis_3316_vec_.size() > 0) {
+      return sis_3316_vec_[0].system_clock * 1.0e-6;
+
+    } else if (sis_3302_vec_.size() > 0) {
+      return sis_3302_vec_[0].system_clock * 1.0e-6;
+    }
+
+    return 0.0;
+  };
+
+  void WriteBanks(char *pevent) {
+    int count;
+    char bk_name[10];
+    WORD *pdata;
+
+    count = 0;
+    for (auto &sis : sis_3316_vec_) {
+
+      sprintf(bk_name, "16_%01i", count++);
+      bk_create(pevent, bk_name, TID_WORD, &pdata);
+      pdata = std::copy(&sis.trace[0][0],
+                        &sis.trace[0][0] + SIS_3316_CH*SIS_3316_LN, pdata);
+      bk_close(pevent, pdata);
+    }
+
+    count = 0;
+    for (auto &sis : sis_3302_vec_) {
+
+      sprintf(bk_name, "02_%01i", count++);
+      bk_create(pevent, bk_name, TID_WORD, &pdata);
+      pdata = std::copy(&sis.trace[0][0],
+                        &sis.trace[0][0] + SIS_3302_CH*SIS_3302_LN, pdata);
+      bk_close(pevent, pdata);
+    }
+  };
+
+  void Rewind() { entry_ = -1; };
+
+ private:
+  TFile *pf_;
+  TTree *t_sis3316_;
+  TTree *t_sis3302_;
+  Long64_t entry_;
+  std::vector<sis_3316_board> sis_3316_vec_;
+  std::vector<sis_3302_board> sis_3302_vec_;
+
+  template <typename T>
+  void Bind(TTree *t, const char *fmt, std::vector<T> &boards) {
+    char name[64];
+    int num_boards = 0;
+
+    if (t == nullptr) return;
+
+    sprintf(name, fmt, num_boards);
+    while (util::HasBoard(t, name)) {
+      sprintf(name, fmt, ++num_boards);
+    }
+
+    // Size first, binding holds on to the addresses.
+    boards.resize(num_boards);
+    t->SetBranchStatus("*", 0);
+
+    for (int i = 0; i < num_boards; ++i) {
+      sprintf(name, fmt, i);
+      util::SetBoardAddress(t, name, boards[i]);
+    }
+  };
+};
+
+// Replays the digitizer banks of MIDAS files, gzip or not.
+class MidasSource : public ReplaySource {
+ public:
+  MidasSource(const string& filename) : filename_(filename), failed_(false) {
+    fp_ = gzopen(filename.c_str(), "rb");
+  };
+
+  ~MidasSource() {
+    if (fp_ != nullptr) gzclose(fp_);
+  };
+
+  bool Next() {
+    if (fp_ == nullptr || failed_) return false;
+
+    while (true) {
+
+      int n = gzread(fp_, &header_, sizeof(header_));
+
+      if (n == 0) {
+        return false;
+
+      } else if (n != sizeof(header_)) {
+        return Fail("truncated event header");
+      }
+
+      // No event this frontend can send is larger, so the header is bad.
+      if (header_.data_size > (DWORD)max_event_size) {
+        return Fail("corrupt event header");
+      }
+
+      if (buffer_.size() < header_.data_size + 1) {
+        buffer_.resize(header_.data_size + 1);
+      }
+
+      int size = header_.data_size;
+      if (gzread(fp_, &buffer_[0], size) != size) {
+        return Fail("truncated event");
+      }
+
+      // Skip the ODB dumps and messages, the ids are 16-bit.
+      WORD id = header_.event_id;
+      if (id != (WORD)EVENTID_BOR &&
+          id != (WORD)EVENTID_EOR &&
+          id != (WORD)EVENTID_MESSAGE) {
+
+        if (header_.data_size < sizeof(BANK_HEADER)) {
+          return Fail("event without a bank header");
+        }
+
+        return true;
+      }
+    }
+  };
+
+  // MIDAS only stamps events with whole seconds.
+  double Time() { return header_.time_stamp; };
+
+  void WriteBanks(char *pevent) {
+    auto pbh = (BANK_HEADER *)&buffer_[0];
+    bool is_32bit = pbh->flags & BANK_FORMAT_32BIT;
+    bool is_64bit_aligned = pbh->flags & BANK_FORMAT_64BIT_ALIGNED;
+
+    // The banks can't reach past the event that was read.
+    char *p = (char *)(pbh + 1);
+    char *end = p + std::min<size_t>(pbh->data_size, header_.data_size -
+                                     sizeof(BANK_HEADER));
+
+    size_t head = sizeof(BANK);
+    if (is_64bit_aligned) {
+      head = sizeof(BANK32A);
+
+    } else if (is_32bit) {
+      head = sizeof(BANK32);
+    }
+
+    while ((size_t)(end - p) >= head) {
+
+      char name[5];
+      DWORD type, size;
+      char *pbank = p + head;
+
+      strncpy(name, p, 4);
+      name[4] = 0;
+
+      if (is_64bit_aligned) {
+        type = ((BANK32A *)p)->type;
+        size = ((BANK32A *)p)->data_size;
+
+      } else if (is_32bit) {
+        type = ((BANK32 *)p)->type;
+        size = ((BANK32 *)p)->data_size;
+
+      } else {
+        type = ((BANK *)p)->type;
+        size = ((BANK *)p)->data_size;
+      }
+
+      // A bank running past the event means the rest is garbage.
+      if (size > (size_t)(end - pbank)) {
+        banks_skipped++;
+        return;
+      }
+
+      // Digitizer traces, dense or zero-suppressed, and features.
+      if (strncmp(name, "16_", 3) == 0 || strncmp(name, "02_", 3) == 0 ||
+          strncmp(name, "Z16", 3) == 0 || strncmp(name, "Z02", 3) == 0 ||
+          strcmp(name, "FEAT") == 0) {
+
+        // The outgoing event is bank32, leave out what doesn't fit.
+        if (bk_size(pevent) + sizeof(BANK32) + ALIGN8(size) >
+            (size_t)max_event_size) {
+          banks_skipped++;
+
+        } else {
+          char *pdata;
+          bk_create(pevent, name, type, &pdata);
+          memcpy(pdata, pbank, size);
+          bk_close(pevent, pdata + size);
+        }
+      }
+
+      if (ALIGN8(size) >= (size_t)(end - pbank)) return;
+      p = pbank + ALIGN8(size);
+    }
+  };
+
+  void Rewind() { gzrewind(fp_); };
+
+ private:
+  string filename_;
+  gzFile fp_;
+  bool failed_;  // stays set, looping would hit the same spot again
+  EVENT_HEADER header_;
+  std::vector<char> buffer_;
+
+  bool Fail(const char *what) {
+    cm_msg(MERROR, frontend_name, "%s in %s, replay stops here", what,
+           filename_.c_str());
+    failed_ = true;
+    return false;
+  };
+};
+
+ReplaySource *source = nullptr;
+string replay_file;
+string replay_mode;
+double replay_rate;
+BOOL replay_loop;
+bool event_staged;
+double first_event_time;
+unsigned long long events_sent;
+unsigned long long bytes_sent;
+unsigned long long pace_events;
+std::chrono::steady_clock::time_point run_start;
+std::chrono::steady_clock::time_point pace_start;
+}
+
+//--- Frontend Init -------------------------------------------------//
+INT frontend_init()
+{
+  return SUCCESS;
+}
+
+//--- Frontend Exit ------------------------------------------------//
+INT frontend_exit()
+{
+  if (source != nullptr) {
+    delete source;
+  }
+
+  return SUCCESS;
+}
+
+//--- Begin of Run --------------------------------------------------*/
+INT begin_of_run(INT run_number, char *error)
+{
+  HNDLE hDB;
+  char str[256];
+  int size;
+
+  cm_get_experiment_database(&hDB, NULL);
+
+  str[0] = 0;
+  size = sizeof(str);
+  db_get_value(hDB, 0, "/Params/replay/file",
+               str, &size, TID_STRING, TRUE);
+  replay_file = string(str);
+
+  sprintf(str, "afap");
+  size = sizeof(str);
+  db_get_value(hDB, 0, "/Params/replay/mode",
+               str, &size, TID_STRING, TRUE);
+  replay_mode = string(str);
+
+  replay_rate = 100.0;
+  size = sizeof(replay_rate);
+  db_get_value(hDB, 0, "/Params/replay/rate",
+               &replay_rate, &size, TID_DOUBLE, TRUE);
+
+  replay_loop = FALSE;
+  size = sizeof(replay_loop);
+  db_get_value(hDB, 0, "/Params/replay/loop",
+               &replay_loop, &size, TID_BOOL, TRUE);
+
+  if (source != nullptr) {
+    delete source;
+    source = nullptr;
+  }
+
+  if (replay_file.find(".root") != string::npos) {
+    source = new RootSource(replay_file);
+
+  } else {
+    source = new MidasSource(replay_file);
+  }
+
+  event_staged = source->Next();
+
+  if (!event_staged) {
+    cm_msg(MERROR, frontend_name, "nothing to replay in \"%s\"",
+           replay_file.c_str());
+    sprintf(error, "nothing to replay in %s", replay_file.c_str());
+    return FE_ERR_HW;
+  }
+
+  cm_msg(MINFO, frontend_name, "replaying %s in %s mode",
+         replay_file.c_str(), replay_mode.c_str());
+
+  first_event_time = source->Time();
+  banks_skipped = 0;
+  events_sent = 0;
+  bytes_sent = 0;
+  pace_events = 0;
+  run_start = std::chrono::steady_clock::now();
+  pace_start = run_start;
+
+  return SUCCESS;
+}
+
+//--- End of Run ----------------------------------------------------*/
+INT end_of_run(INT run_number, char *error)
+{
+  HNDLE hDB;
+  double elapsed, val;
+
+  using namespace std::chrono;
+  elapsed = duration<double>(steady_clock::now() - run_start).count();
+
+  cm_msg(MINFO, frontend_name, "replayed %llu events, %.1f MB in %.1f s: "
+         "%.1f events/s, %.2f MB/s", events_sent, bytes_sent * 1.0e-6,
+         elapsed, events_sent / elapsed, bytes_sent * 1.0e-6 / elapsed);
+
+  if (banks_skipped > 0) {
+    cm_msg(MERROR, frontend_name, "left out %llu corrupt or oversized banks",
+           banks_skipped);
+  }
+
+  cm_get_experiment_database(&hDB, NULL);
+
+  val = events_sent / elapsed;
+  db_set_value(hDB, 0, "/Equipment/fe-replay/Metrics/events-per-sec",
+               &val, sizeof(val), 1, TID_DOUBLE);
+
+  val = bytes_sent * 1.0e-6 / elapsed;
+  db_set_value(hDB, 0, "/Equipment/fe-replay/Metrics/mb-per-sec",
+               &val, sizeof(val), 1, TID_DOUBLE);
+
+  return SUCCESS;
+}
+
+//--- Pause Run -----------------------------------------------------*/
+INT pause_run(INT run_number, char *error)
+{
+  return SUCCESS;
+}
+
+//--- Resuem Run ----------------------------------------------------*/
+INT resume_run(INT run_number, char *error)
+{
+  return SUCCESS;
+}
+
+//--- Frontend Loop -------------------------------------------------*/
+
+INT frontend_loop()
+{
+  // If frontend_call_loop is true, this routine gets called when
+  // the frontend is idle or once between every event
+  return SUCCESS;
+}
+
+//-------------------------------------------------------------------*/
+
+/********************************************************************\
+
+  Readout routines for different events
+
+\********************************************************************/
+
+//--- Trigger event routines ----------------------------------------*/
+
+INT poll_event(INT source_id, INT count, BOOL test) {
+  unsigned int i;
+
+  // fake calibration
+  if (test) {
+    for (i = 0; i < count; i++) {
+      usleep(10);
+    }
+    return 0;
+  }
+
+  if (!event_staged) {
+    return 0;
+  }
+
+  // Work out when the staged event is due.
+  double due = 0.0;
+
+  if (replay_mode == "original") {
+    due = source->Time() - first_event_time;
+
+  } else if (replay_mode == "fixed" && replay_rate > 0.0) {
+    due = pace_events / replay_rate;
+  }
+
+  using namespace std::chrono;
+  double now = duration<double>(steady_clock::now() - pace_start).count();
+
+  return (now >= due) ? 1 : 0;
+}
+
+//--- Interrupt configuration ---------------------------------------*/
+
+INT interrupt_configure(INT cmd, INT source_id, PTYPE adr)
+{
+  switch (cmd) {
+  case CMD_INTERRUPT_ENABLE:
+    break;
+  case CMD_INTERRUPT_DISABLE:
+    break;
+  case CMD_INTERRUPT_ATTACH:
+    break;
+  case CMD_INTERRUPT_DETACH:
+    break;
+  }
+  return SUCCESS;
+}
+
+//--- Event readout -------------------------------------------------*/
+
+INT read_trigger_event(char *pevent, INT off)
+{
+  bk_init32(pevent);
+  source->WriteBanks(pevent);
+
+  events_sent++;
+  pace_events++;
+  bytes_sent += bk_size(pevent);
+
+  // Stage the next one, starting over if asked to.
+  event_staged = source->Next();
+
+  if (!event_staged && replay_loop) {
+    source->Rewind();
+    event_staged = source->Next();
+
+    // Pace the next pass from scratch.
+    pace_start = std::chrono::steady_clock::now();
+    pace_events = 0;
+    first_event_time = source->Time();
+  }
+
+  return bk_size(pevent);
+}
@@ -23,16 +23,29 @@ About:  The code implements a MIDAS frontend that wraps basic routines
 #include <array>
 #include <cmath>
 #include <string>
+#include <chrono>
+#include <algorithm>
 using std::string;
 
 //--- other includes -----------------------------------------------//
 #include "midas.h"
 #include "TFile.h"
 #include "TTree.h"
+#include "TROOT.h"
+#include "boost/property_tree/json_parser.hpp"
 
 //--- project includes ---------------------------------------------//
-#include "event_manager_basic.hh"
 #include "common.hh"
+#include "experim.h"
+#include "util/realtime.hh"
+#include "util/pulse_features.hh"
+#include "util/zero_suppress.hh"
+#include "util/root_output.hh"
+#include "util/readout_backend.hh"
+#include "util/param_cache.hh"
+#include "util/adaptive_poll.hh"
+#include "util/prearm.hh"
+#include "util/readout_odb.hh"
 
 
 //--- globals ------------------------------------------------------//
@@ -86,7 +99,7 @@ extern "C" {
          TRUE,          // enabled 
          RO_RUNNING,// |   // read only when running 
          //         RO_ODB,        // and update ODB 
-         25,            // poll for 500ms 
+         25,            // poll for 25ms, see /Params/readout/fe-sis3316/poll
          0,             // stop run after this event limit 
          0,             // number of sub events 
          0,             // don't log history 
@@ -101,6 +114,7 @@ extern "C" {
 } //extern C
 
 RUNINFO runinfo;
+GLOBAL_PARAM global_param;
 
 // Anonymous namespace for my "globals"
 namespace {
@@ -110,125 +124,208 @@ bool run_in_progress = false;
 bool write_root = true;
 bool write_midas = true;
 daq::event_data data;
-daq::EventManagerBasic* event_manager;
+util::ReadoutBackend* event_manager;
+util::ParamCache params;
+util::JitterMonitor jitter;
+util::AdaptivePoller poller;
+util::feature_config features;
+util::zs_config zero_suppress;
+std::vector<WORD> zs_buffer;
+unsigned long long trace_bytes_total = 0;
+unsigned long long trace_bytes_written = 0;
+
+string conf_file;
+util::PreArmer prearm(params);
 }
 
+util::armed_run arm_run(int run_number);
+
 //--- Frontend Init -------------------------------------------------//
 INT frontend_init() 
 {
-  string conf_file;
   HNDLE hDB, hkey;
-  INT status, size;
-  char str[256];
-  
+
   cm_get_experiment_database(&hDB, NULL);
-  db_find_key(hDB, 0, "Params/config-dir", &hkey);
-    
-  if (hkey) {
-    size = sizeof(str);
-    db_get_data(hDB, hkey, str, &size, TID_STRING);
-    if (str[strlen(str) - 1] != DIR_SEPARATOR) {
-      strcat(str, DIR_SEPARATOR_STR);
-    }
+
+  conf_file = params.Dir("/Params/config-dir") + 
+    params.String("/Params/config-file/fe-sis3316");
+
+  event_manager = util::MakeReadoutBackend(conf_file);
+
+  // The shared ADC threshold, hot-linked so edits apply immediately.
+  GLOBAL_PARAM_STR(global_param_str);
+  db_create_record(hDB, 0, "/Params/Global", strcomb(global_param_str));
+  db_find_key(hDB, 0, "/Params/Global", &hkey);
+
+  if (db_open_record(hDB, hkey, &global_param, sizeof(global_param), 
+                     MODE_READ, NULL, NULL) != DB_SUCCESS) {
+    cm_msg(MERROR, frontend_name, "Cannot open \"/Params/Global\" in ODB");
+    return FE_ERR_ODB;
+  }
+
+  // Hot-linked once here rather than at every begin of run.
+  db_find_key(hDB, 0, "/Runinfo", &hkey);
+  if (db_open_record(hDB, hkey, &runinfo, sizeof(runinfo), MODE_READ,
+		     NULL, NULL) != DB_SUCCESS) {
+    cm_msg(MERROR, frontend_name, "Cannot open \"/Runinfo\" tree in ODB");
+    return FE_ERR_ODB;
   }
 
-  conf_file = std::string(str);
+  // Pin the readout path, threads started by the event manager at the
+  // beginning of each run inherit both the affinity and the scheduler.
+  string cpu_list = params.String("/Params/readout/fe-sis3316/cpu-list");
+  int rt_priority = params.Int("/Params/readout/fe-sis3316/rt-priority");
 
-  db_find_key(hDB, 0, "Params/config-file/fe-sis3316", &hkey);
-  if (hkey) {
-    size = sizeof(str);
-    db_get_data(hDB, hkey, str, &size, TID_STRING);
+  if (util::SetThreadAffinity(util::ParseCpuList(cpu_list)) != 0) {
+    cm_msg(MERROR, frontend_name, "failed to set cpu affinity to %s", 
+           cpu_list.c_str());
   }
 
-  conf_file += std::string(str);
+  if (util::SetRealtimePriority(rt_priority) != 0) {
+    cm_msg(MERROR, frontend_name, 
+           "failed to set SCHED_FIFO priority %i, check rtprio limits", 
+           rt_priority);
+  }
+
+  // Files are created by a helper thread and filled by this one.
+  ROOT::EnableThreadSafety();
+  prearm.Launch(arm_run, runinfo.run_number + 1);
 
-  event_manager = new daq::EventManagerBasic(conf_file);
   return SUCCESS;
 }
 
 //--- Frontend Exit ------------------------------------------------//
 INT frontend_exit()
 {
+  prearm.Cancel();
+
   delete event_manager;
+  params.Close();
   return SUCCESS;
 }
 
-//--- Begin of Run --------------------------------------------------*/
-INT begin_of_run(INT run_number, char *error)
+//--- Pre-arm -----------------------------------------------------*/
+
+// The boards of each family the event data is sized for.
+std::vector<int> board_counts()
 {
-  //HW part
-  event_manager->BeginOfRun();
-  event_manager->ResizeEventData(data);
-  cm_msg(MINFO, frontend_name, "event manager loaded.");
+  return {(int)data.sis_3316_vec.size(), (int)data.sis_3302_vec.size()};
+}
 
-  //DATA part
-  HNDLE hDB, hkey;
-  INT status;
-  BOOL mstatus;
-  char str[256], filename[256];
-  int size;
-    
-  cm_get_experiment_database(&hDB, NULL);
-  db_find_key(hDB, 0, "/Logger/Data dir", &hkey);
-    
-  if (hkey) {
-    size = sizeof(str);
-    db_get_data(hDB, hkey, str, &size, TID_STRING);
-    if (str[strlen(str) - 1] != DIR_SEPARATOR) {
-      strcat(str, DIR_SEPARATOR_STR);
-    }
-  }
-    
-  db_find_key(hDB, 0, "/Runinfo", &hkey);
-  if (db_open_record(hDB, hkey, &runinfo, sizeof(runinfo), MODE_READ,
-		     NULL, NULL) != DB_SUCCESS) {
-    cm_msg(MERROR, "analyzer_init", "Cannot open \"/Runinfo\" tree in ODB");
-    return 0;
-  }
+// Check the config, size the event data and create the ROOT output of
+// a run.  Runs between runs, while nothing reads out.
+util::armed_run arm_run(int run_number)
+{
+  util::armed_run run;
+  run.run_number = run_number;
 
-  db_find_key(hDB, 0, "/Params/midas-output", &hkey);
-  if (hkey) {
-    size = sizeof(mstatus);
-    db_get_data(hDB, hkey, &mstatus, &size, TID_BOOL);
-    write_midas = mstatus;
-  }
+  try {
+    boost::property_tree::ptree conf;
+    boost::property_tree::read_json(conf_file, conf);
 
-  db_find_key(hDB, 0, "/Params/root-output", &hkey);
-  if (hkey) {
-    size = sizeof(mstatus);
-    db_get_data(hDB, hkey, &mstatus, &size, TID_BOOL);
-    write_root = mstatus;
+  } catch (std::exception &e) {
+    run.error = "config " + conf_file + " does not parse: " + e.what();
+    cm_msg(MERROR, frontend_name, "%s", run.error.c_str());
+    return run;
   }
-  
-  if (write_root) {
-    // Get the run number out of the MIDAS database.
-    strcpy(filename, str);
-    sprintf(str, "fe_sis3316_run_%05d.root", runinfo.run_number);
-    strcat(filename, str);
-    
-    // Set up the ROOT data output.
-    root_file = new TFile(filename, "recreate");
-    t = new TTree("t_sis3316", "SIS3316 Data");
-    t->SetAutoSave(0);
-    t->SetAutoFlush(0);
-    
+
+  // The branches point into the event data, so it is sized first.
+  event_manager->ResizeEventData(data);
+
+  run = util::OpenRunOutput(
+    params, frontend_name, run_number, "fe_sis3316_run_%05d.root",
+    {{"t_sis3316", "SIS3316 Data"}});
+  run.boards = board_counts();
+
+  if (run.file != nullptr) {
     int count;
-    char branch_vars[100];
     char branch_name[100];
-    
+
     count = 0;
     for (auto &sis : data.sis_3316_vec) {
-      
-      sprintf(branch_name, "sis_3316_%i", count);
-      sprintf(branch_vars, "system_clock/l:device_clock[%i]/l:trace[%i][%i]/s",
-              SIS_3316_CH, SIS_3316_CH, SIS_3316_LN);
-      
-      t->Branch(branch_name, &data.sis_3316_vec[count++], branch_vars);
+
+      sprintf(branch_name, "sis_3316_%i", count++);
+      util::BranchBoard(run.trees[0], branch_name, sis, run.layout,
+                        run.conf.basket_size);
     }
   }
 
+  return run;
+}
+
+//--- Begin of Run --------------------------------------------------*/
+INT begin_of_run(INT run_number, char *error)
+{
+  auto t0 = std::chrono::steady_clock::now();
+
+  // Take the pre-armed output unless the run number or the output
+  // parameters changed since it was made.
+  bool prearmed;
+  util::armed_run run = prearm.Take(arm_run, run_number, prearmed);
+
+  if (!run.error.empty()) {
+    snprintf(error, TRANSITION_ERROR_STRING_LENGTH, "%s", run.error.c_str());
+    return FE_ERR_HW;
+  }
+
+  write_midas = params.Bool("/Params/midas-output", true);
+  
+  // Optional online feature extraction.
+  string prefix = "/Params/features/fe-sis3316/";
+  features.enabled = params.Bool(prefix + "enabled");
+  features.baseline_samples = params.Int(prefix + "baseline-samples", 64);
+  features.trace_prescale = params.Int(prefix + "trace-prescale", 100);
+  features.anomaly_amplitude = params.Double(prefix + "anomaly-amplitude");
+
+  // Optional zero-suppression, the threshold is /Params/Global.
+  zero_suppress = util::ReadZeroSuppressConfig(
+    params, "/Params/zero-suppression/fe-sis3316/", frontend_name);
+
+  if (zero_suppress.enabled) {
+    zs_buffer.resize(util::ZeroSuppressMaxWords(SIS_3316_CH, SIS_3316_LN));
+  }
+
+  trace_bytes_total = 0;
+  trace_bytes_written = 0;
+
+  // How poll_event waits, spin, back off, then park.
+  poller.set_policy(util::ReadPollPolicy(
+    params, "/Params/readout/fe-sis3316/", equipment[0].info.period));
+
+  //HW part
+  event_manager->BeginOfRun();
+
+  // The boards are only known once the hardware is set up, trees
+  // branched for others would point past the event data.
+  event_manager->ResizeEventData(data);
+
+  if (board_counts() != run.boards) {
+    util::Disarm(run);
+    run = arm_run(run_number);
+    prearmed = false;
+
+    if (!run.error.empty()) {
+      event_manager->EndOfRun();
+      snprintf(error, TRANSITION_ERROR_STRING_LENGTH, "%s", run.error.c_str());
+      return FE_ERR_HW;
+    }
+  }
+
+  root_file = run.file;
+  t = run.file ? run.trees[0] : nullptr;
+  write_root = (run.file != nullptr);
+  jitter.Reset();
+  poller.Reset();
   run_in_progress = true;
 
+  auto t1 = std::chrono::steady_clock::now();
+
+  double start_ms = std::chrono::duration<double>(t1 - t0).count() * 1.0e3;
+  util::PublishStartMetrics("fe-sis3316", start_ms, run.arm_ms, prearmed);
+
+  cm_msg(MINFO, frontend_name, "started run %i in %.1f ms%s", run_number,
+         start_ms, prearmed ? ", output pre-armed" : "");
+
   return SUCCESS;
 }
 
@@ -237,6 +334,19 @@ INT end_of_run(INT run_number, char *error)
 {
   event_manager->EndOfRun();
 
+  // Report the latency between poll and readout for the run.
+  util::PublishReadoutMetrics(frontend_name, "fe-sis3316", jitter, poller,
+                              event_manager->dropped_events());
+
+  if ((features.enabled || zero_suppress.enabled) && trace_bytes_total > 0) {
+    double val = (double)trace_bytes_total /
+      std::max(trace_bytes_written, 1ULL);
+    cm_msg(MINFO, frontend_name, "wrote %llu of %llu dense trace bytes, "
+           "reduction x%.1f", trace_bytes_written, trace_bytes_total, val);
+
+    util::PublishMetric("fe-sis3316", "trace-reduction", val);
+  }
+
   // Make sure we write the ROOT data.
   if (run_in_progress) {
 
@@ -253,6 +363,9 @@ INT end_of_run(INT run_number, char *error)
 
   // Merge the files into a single file @TODO
   
+  // Set up the output of the next run while the system is idle.
+  prearm.Launch(arm_run, run_number + 1);
+
   return SUCCESS;
 }
 
@@ -302,7 +415,12 @@ INT poll_event(INT source, INT count, BOOL test) {
     return 0;
   }
     
-  return ((event_manager->HasEvent() == true)? 1 : 0);
+  if (poller.Wait([] { return event_manager->HasEvent(); })) {
+    jitter.MarkPoll();
+    return 1;
+  }
+
+  return 0;
 }
 
 //--- Interrupt configuration ---------------------------------------*/
@@ -333,46 +451,96 @@ INT read_trigger_event(char *pevent, INT off)
   int count = 0;
   char bk_name[10];
   WORD *pdata;
+  float *pfeat;
+  bool keep_traces = true;
+
+  jitter.MarkReadout();
+
+  // Copy the data, no more boards than the run was set up for.
+  auto &event = event_manager->GetCurrentEvent();
+  count = std::min(event.sis_3316_vec.size(), data.sis_3316_vec.size());
+  std::copy(event.sis_3316_vec.begin(), event.sis_3316_vec.begin() + count,
+            data.sis_3316_vec.begin());
+
+  // Pop the event now that we are done copying it.
+  event_manager->PopCurrentEvent();
+  num_events++;
 
   // ROOT output
   if (run_in_progress && write_root) {
 
-    // Copy the data
-    count = 0;
-    for (auto &sis : event_manager->GetCurrentEvent().sis_3316_vec) {
-      data.sis_3316_vec[count++] = sis;
-    }
+    // Now that we have a copy of the latest event, fill the tree, the
+    // flush policy takes care of writing baskets out.
+    t->Fill();
+  }
 
-    // Pop the event now that we are done copying it.
-    event_manager->PopCurrentEvent();
+  bk_init32(pevent);
 
-    // Now that we have a copy of the latest event, fill the tree.
-    t->Fill();
-    num_events++;
+  // Reduce every channel to a few features, traces are then only kept
+  // for prescaled or anomalous events.
+  if (write_midas && features.enabled) {
 
-    if (num_events % 1000 == 1) {
+    bool anomalous = false;
+    bk_create(pevent, "FEAT", TID_FLOAT, &pfeat);
+    auto pf = (util::pulse_features *)pfeat;
 
-      t->AutoSave("SaveSelf,FlushBaskets");
-      root_file->Flush();
+    for (auto &sis : data.sis_3316_vec) {
 
+      util::ExtractFeatures(&sis.trace[0][0], SIS_3316_CH, SIS_3316_LN,
+                            features.baseline_samples, pf);
+
+      anomalous |= util::IsAnomalous(pf, SIS_3316_CH, features);
+      pf += SIS_3316_CH;
     }
+
+    bk_close(pevent, pf);
+
+    keep_traces = anomalous || (features.trace_prescale > 0 && 
+                                num_events % features.trace_prescale == 0);
   }
 
-  bk_init32(pevent);
+  if (write_midas) {
+    trace_bytes_total += data.sis_3316_vec.size() * 
+      sizeof(data.sis_3316_vec[0].trace);
+  }
     
   // And MIDAS output.
-  if (write_midas) {
+  if (write_midas && keep_traces) {
+
+    zero_suppress.threshold = global_param.adc_threshold;
 
     count = 0;
     for (auto &sis : data.sis_3316_vec) {
-      
-      sprintf(bk_name, "16_%01i", count++);
-      bk_create(pevent, bk_name, TID_WORD, &pdata);
-      std::copy(&sis.trace[0][0], 
-                &sis.trace[0][0] + SIS_3316_CH*SIS_3316_LN, 
-                pdata);
-      pdata += sizeof(sis.trace) / sizeof(sis.trace[0][0]);
-      bk_close(pevent, pdata);
+
+      int num_words = SIS_3316_CH*SIS_3316_LN;
+
+      if (zero_suppress.enabled) {
+        num_words = util::ZeroSuppress(&sis.trace[0][0], SIS_3316_CH, 
+                                       SIS_3316_LN, zero_suppress, 
+                                       &zs_buffer[0]);
+      }
+
+      // Fall back to the dense bank if suppression does not pay off.
+      if (num_words < SIS_3316_CH*SIS_3316_LN) {
+
+        sprintf(bk_name, "Z16%01i", count++);
+        bk_create(pevent, bk_name, TID_WORD, &pdata);
+        pdata = std::copy(&zs_buffer[0], &zs_buffer[0] + num_words, pdata);
+        bk_close(pevent, pdata);
+
+      } else {
+
+        num_words = SIS_3316_CH*SIS_3316_LN;
+        sprintf(bk_name, "16_%01i", count++);
+        bk_create(pevent, bk_name, TID_WORD, &pdata);
+        std::copy(&sis.trace[0][0], 
+                  &sis.trace[0][0] + SIS_3316_CH*SIS_3316_LN, 
+                  pdata);
+        pdata += sizeof(sis.trace) / sizeof(sis.trace[0][0]);
+        bk_close(pevent, pdata);
+      }
+
+      trace_bytes_written += num_words * sizeof(WORD);
     }
   }
 
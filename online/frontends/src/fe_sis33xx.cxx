@@ -0,0 +1,639 @@
+/********************************************************************\
+
+Name:   fe_sis33xx.cxx
+Author: Matthias W. Smith
+Email:  mwsmith2@uw.edu
+
+About:  A single MIDAS frontend for a crate with both Struck SIS3316
+        and SIS3302 VME devices, in place of running fe_sis3316 and
+        fe_sis3302 side by side.  One event manager reads out every
+        board in its config, each on its own worker thread, and every
+        trigger goes out as one MIDAS event carrying the 16_N and 02_N
+        banks.  The ROOT output is written straight to run_N.root, so
+        there is no merge after the run.  Features and zero-suppression
+        follow the keys of the two single family frontends.
+
+\********************************************************************/
+
+//--- std includes -------------------------------------------------//
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <array>
+#include <cmath>
+#include <string>
+#include <chrono>
+#include <algorithm>
+using std::string;
+
+//--- other includes -----------------------------------------------//
+#include "midas.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TROOT.h"
+#include "boost/property_tree/json_parser.hpp"
+
+//--- project includes ---------------------------------------------//
+#include "common.hh"
+#include "experim.h"
+#include "util/realtime.hh"
+#include "util/pulse_features.hh"
+#include "util/zero_suppress.hh"
+#include "util/root_output.hh"
+#include "util/readout_backend.hh"
+#include "util/param_cache.hh"
+#include "util/adaptive_poll.hh"
+#include "util/prearm.hh"
+#include "util/readout_odb.hh"
+
+
+//--- globals ------------------------------------------------------//
+
+extern "C" {
+
+  // The frontend name (client name) as seen by other MIDAS clients
+  char *frontend_name = (char*) "fe-sis33xx";
+
+  // The frontend file name, don't change it.
+  char *frontend_file_name = (char*) __FILE__;
+
+  // frontend_loop is called periodically if this variable is TRUE
+  BOOL frontend_call_loop = FALSE;
+
+  // A frontend status page is displayed with this frequency in ms.
+  INT display_period = 1000;
+
+  // maximum event size produced by this frontend, both families
+  INT max_event_size = 0x600000;
+
+  // maximum event size for fragmented events (EQ_FRAGMENTED)
+  INT max_event_size_frag = 0x1000000;
+
+  // buffer size to hold events
+  INT event_buffer_size = 0x8000000;
+
+  // Function declarations
+  INT frontend_init();
+  INT frontend_exit();
+  INT begin_of_run(INT run_number, char *error);
+  INT end_of_run(INT run_number, char *error);
+  INT pause_run(INT run_number, char *error);
+  INT resume_run(INT run_number, char *error);
+
+  INT frontend_loop();
+  INT read_trigger_event(char *pevent, INT off);
+  INT poll_event(INT source, INT count, BOOL test);
+  INT interrupt_configure(INT cmd, INT source, PTYPE adr);
+
+  // Equipment list
+
+  EQUIPMENT equipment[] =
+    {
+      {"fe-sis33xx",     // equipment name
+       { 1, 0,          // event ID, trigger mask
+         "SYSTEM",      // event buffer
+         EQ_POLLED,     // equipment type
+         0,             // not used
+         "MIDAS",       // format
+         TRUE,          // enabled
+         RO_RUNNING,    // read only when running
+         25,            // poll for 25ms, see /Params/readout/fe-sis33xx/poll
+         0,             // stop run after this event limit
+         0,             // number of sub events
+         0,             // don't log history
+         "", "", "",
+       },
+       read_trigger_event,      // readout routine
+      },
+
+      {""}
+    };
+
+} //extern C
+
+RUNINFO runinfo;
+GLOBAL_PARAM global_param;
+
+// Anonymous namespace for my "globals"
+namespace {
+
+// The output settings of one digitizer family.
+struct family_output {
+  const char *fe_name;     // the single family frontend, for its keys
+  const char *bank;        // prefix of the dense banks
+  const char *zs_bank;     // prefix of the zero-suppressed banks
+  int num_ch;
+  int len;
+  util::feature_config features;
+  util::zs_config zero_suppress;
+  std::vector<WORD> zs_buffer;
+  bool keep_traces;
+};
+
+TFile* root_file;
+TTree* t_sis3316;
+TTree* t_sis3302;
+bool run_in_progress = false;
+bool write_root = true;
+bool write_midas = true;
+daq::event_data data;
+util::ReadoutBackend* event_manager;
+util::ParamCache params;
+util::JitterMonitor jitter;
+util::AdaptivePoller poller;
+family_output out_sis3316 = {"fe-sis3316", "16_", "Z16",
+                             SIS_3316_CH, SIS_3316_LN};
+family_output out_sis3302 = {"fe-sis3302", "02_", "Z02",
+                             SIS_3302_CH, SIS_3302_LN};
+unsigned long long trace_bytes_total = 0;
+unsigned long long trace_bytes_written = 0;
+
+string conf_file;
+util::PreArmer prearm(params);
+}
+
+util::armed_run arm_run(int run_number);
+void read_family_params(family_output &fam);
+
+template <typename T>
+float *extract_features(std::vector<T> &boards, family_output &fam,
+                        float *pfeat, unsigned long long num_events);
+
+template <typename T>
+void write_trace_banks(char *pevent, std::vector<T> &boards,
+                       family_output &fam);
+
+//--- Frontend Init -------------------------------------------------//
+INT frontend_init()
+{
+  HNDLE hDB, hkey;
+
+  cm_get_experiment_database(&hDB, NULL);
+
+  // One config with the boards of both families.
+  conf_file = params.Dir("/Params/config-dir") +
+    params.String("/Params/config-file/fe-sis33xx");
+
+  event_manager = util::MakeReadoutBackend(conf_file);
+
+  // The shared ADC threshold, hot-linked so edits apply immediately.
+  GLOBAL_PARAM_STR(global_param_str);
+  db_create_record(hDB, 0, "/Params/Global", strcomb(global_param_str));
+  db_find_key(hDB, 0, "/Params/Global", &hkey);
+
+  if (db_open_record(hDB, hkey, &global_param, sizeof(global_param),
+                     MODE_READ, NULL, NULL) != DB_SUCCESS) {
+    cm_msg(MERROR, frontend_name, "Cannot open \"/Params/Global\" in ODB");
+    return FE_ERR_ODB;
+  }
+
+  // Hot-linked once here rather than at every begin of run.
+  db_find_key(hDB, 0, "/Runinfo", &hkey);
+  if (db_open_record(hDB, hkey, &runinfo, sizeof(runinfo), MODE_READ,
+		     NULL, NULL) != DB_SUCCESS) {
+    cm_msg(MERROR, frontend_name, "Cannot open \"/Runinfo\" tree in ODB");
+    return FE_ERR_ODB;
+  }
+
+  // Pin the readout path, threads started by the event manager at the
+  // beginning of each run inherit both the affinity and the scheduler.
+  string cpu_list = params.String("/Params/readout/fe-sis33xx/cpu-list");
+  int rt_priority = params.Int("/Params/readout/fe-sis33xx/rt-priority");
+
+  if (util::SetThreadAffinity(util::ParseCpuList(cpu_list)) != 0) {
+    cm_msg(MERROR, frontend_name, "failed to set cpu affinity to %s",
+           cpu_list.c_str());
+  }
+
+  if (util::SetRealtimePriority(rt_priority) != 0) {
+    cm_msg(MERROR, frontend_name,
+           "failed to set SCHED_FIFO priority %i, check rtprio limits",
+           rt_priority);
+  }
+
+  // Files are created by a helper thread and filled by this one.
+  ROOT::EnableThreadSafety();
+  prearm.Launch(arm_run, runinfo.run_number + 1);
+
+  return SUCCESS;
+}
+
+//--- Frontend Exit ------------------------------------------------//
+INT frontend_exit()
+{
+  prearm.Cancel();
+
+  delete event_manager;
+  params.Close();
+  return SUCCESS;
+}
+
+//--- Pre-arm -----------------------------------------------------*/
+
+// The boards of each family the event data is sized for.
+std::vector<int> board_counts()
+{
+  return {(int)data.sis_3316_vec.size(), (int)data.sis_3302_vec.size()};
+}
+
+// Check the config, size the event data and create the ROOT output of
+// a run.  Runs between runs, while nothing reads out.
+util::armed_run arm_run(int run_number)
+{
+  util::armed_run run;
+  run.run_number = run_number;
+
+  try {
+    boost::property_tree::ptree conf;
+    boost::property_tree::read_json(conf_file, conf);
+
+  } catch (std::exception &e) {
+    run.error = "config " + conf_file + " does not parse: " + e.what();
+    cm_msg(MERROR, frontend_name, "%s", run.error.c_str());
+    return run;
+  }
+
+  // The branches point into the event data, so it is sized first.
+  event_manager->ResizeEventData(data);
+
+  // The name the analyzer gives a merged run, the trees are the same.
+  run = util::OpenRunOutput(
+    params, frontend_name, run_number, "run_%05d.root",
+    {{"t_sis3316", "SIS3316 Data"}, {"t_sis3302", "SIS3302 Data"}});
+  run.boards = board_counts();
+
+  if (run.file != nullptr) {
+    int count;
+    char branch_name[100];
+
+    count = 0;
+    for (auto &sis : data.sis_3316_vec) {
+
+      sprintf(branch_name, "sis_3316_%i", count++);
+      util::BranchBoard(run.trees[0], branch_name, sis, run.layout,
+                        run.conf.basket_size);
+    }
+
+    count = 0;
+    for (auto &sis : data.sis_3302_vec) {
+
+      sprintf(branch_name, "sis_3302_%i", count++);
+      util::BranchBoard(run.trees[1], branch_name, sis, run.layout,
+                        run.conf.basket_size);
+    }
+  }
+
+  return run;
+}
+
+// Features and zero-suppression of a family, from the keys of its own
+// frontend so a crate is set up the same either way it runs.
+void read_family_params(family_output &fam)
+{
+  string prefix = string("/Params/features/") + fam.fe_name + "/";
+  fam.features.enabled = params.Bool(prefix + "enabled");
+  fam.features.baseline_samples = params.Int(prefix + "baseline-samples",
+                                             64);
+  fam.features.trace_prescale = params.Int(prefix + "trace-prescale", 100);
+  fam.features.anomaly_amplitude = params.Double(prefix +
+                                                 "anomaly-amplitude");
+
+  // The threshold is /Params/Global.
+  prefix = string("/Params/zero-suppression/") + fam.fe_name + "/";
+  fam.zero_suppress = util::ReadZeroSuppressConfig(params, prefix,
+                                                   frontend_name);
+
+  if (fam.zero_suppress.enabled) {
+    fam.zs_buffer.resize(util::ZeroSuppressMaxWords(fam.num_ch, fam.len));
+  }
+
+  fam.keep_traces = true;
+}
+
+//--- Begin of Run --------------------------------------------------*/
+INT begin_of_run(INT run_number, char *error)
+{
+  auto t0 = std::chrono::steady_clock::now();
+
+  // Take the pre-armed output unless the run number or the output
+  // parameters changed since it was made.
+  bool prearmed;
+  util::armed_run run = prearm.Take(arm_run, run_number, prearmed);
+
+  if (!run.error.empty()) {
+    snprintf(error, TRANSITION_ERROR_STRING_LENGTH, "%s", run.error.c_str());
+    return FE_ERR_HW;
+  }
+
+  write_midas = params.Bool("/Params/midas-output", true);
+
+  // Optional online feature extraction and zero-suppression.
+  read_family_params(out_sis3316);
+  read_family_params(out_sis3302);
+
+  trace_bytes_total = 0;
+  trace_bytes_written = 0;
+
+  // How poll_event waits, spin, back off, then park.
+  poller.set_policy(util::ReadPollPolicy(
+    params, "/Params/readout/fe-sis33xx/", equipment[0].info.period));
+
+  //HW part
+  event_manager->BeginOfRun();
+
+  // The boards are only known once the hardware is set up, trees
+  // branched for others would point past the event data.
+  event_manager->ResizeEventData(data);
+
+  if (board_counts() != run.boards) {
+    util::Disarm(run);
+    run = arm_run(run_number);
+    prearmed = false;
+
+    if (!run.error.empty()) {
+      event_manager->EndOfRun();
+      snprintf(error, TRANSITION_ERROR_STRING_LENGTH, "%s", run.error.c_str());
+      return FE_ERR_HW;
+    }
+  }
+
+  root_file = run.file;
+  t_sis3316 = run.file ? run.trees[0] : nullptr;
+  t_sis3302 = run.file ? run.trees[1] : nullptr;
+  write_root = (run.file != nullptr);
+  jitter.Reset();
+  poller.Reset();
+  run_in_progress = true;
+
+  auto t1 = std::chrono::steady_clock::now();
+
+  double start_ms = std::chrono::duration<double>(t1 - t0).count() * 1.0e3;
+  util::PublishStartMetrics("fe-sis33xx", start_ms, run.arm_ms, prearmed);
+
+  cm_msg(MINFO, frontend_name, "started run %i with %i SIS3316 and %i "
+         "SIS3302 boards in %.1f ms%s", run_number,
+         (int)data.sis_3316_vec.size(), (int)data.sis_3302_vec.size(),
+         start_ms, prearmed ? ", output pre-armed" : "");
+
+  return SUCCESS;
+}
+
+//--- End of Run ----------------------------------------------------*/
+INT end_of_run(INT run_number, char *error)
+{
+  event_manager->EndOfRun();
+
+  // Report the latency between poll and readout for the run.
+  util::PublishReadoutMetrics(frontend_name, "fe-sis33xx", jitter, poller,
+                              event_manager->dropped_events());
+
+  bool reduced = (out_sis3316.features.enabled ||
+                  out_sis3316.zero_suppress.enabled ||
+                  out_sis3302.features.enabled ||
+                  out_sis3302.zero_suppress.enabled);
+
+  if (reduced && trace_bytes_total > 0) {
+    double val = (double)trace_bytes_total /
+      std::max(trace_bytes_written, 1ULL);
+    cm_msg(MINFO, frontend_name, "wrote %llu of %llu dense trace bytes, "
+           "reduction x%.1f", trace_bytes_written, trace_bytes_total, val);
+
+    util::PublishMetric("fe-sis33xx", "trace-reduction", val);
+  }
+
+  // Make sure we write the ROOT data, the file is the whole run.
+  if (run_in_progress) {
+
+    if (write_root) {
+
+      t_sis3316->Write();
+      t_sis3302->Write();
+      root_file->Close();
+
+      delete root_file;
+    }
+
+    run_in_progress = false;
+  }
+
+  // Set up the output of the next run while the system is idle.
+  prearm.Launch(arm_run, run_number + 1);
+
+  return SUCCESS;
+}
+
+//--- Pause Run -----------------------------------------------------*/
+INT pause_run(INT run_number, char *error)
+{
+  event_manager->PauseRun();
+  return SUCCESS;
+}
+
+//--- Resuem Run ----------------------------------------------------*/
+INT resume_run(INT run_number, char *error)
+{
+  event_manager->ResumeRun();
+  return SUCCESS;
+}
+
+//--- Frontend Loop -------------------------------------------------*/
+
+INT frontend_loop()
+{
+  // If frontend_call_loop is true, this routine gets called when
+  // the frontend is idle or once between every event
+  return SUCCESS;
+}
+
+//-------------------------------------------------------------------*/
+
+/********************************************************************\
+
+  Readout routines for different events
+
+\********************************************************************/
+
+//--- Trigger event routines ----------------------------------------*/
+
+unsigned int failure_count = 0;
+
+INT poll_event(INT source, INT count, BOOL test) {
+  unsigned int i;
+
+  // fake calibration
+  if (test) {
+    for (i = 0; i < count; i++) {
+      usleep(10);
+    }
+    return 0;
+  }
+
+  if (poller.Wait([] { return event_manager->HasEvent(); })) {
+    jitter.MarkPoll();
+    return 1;
+  }
+
+  return 0;
+}
+
+//--- Interrupt configuration ---------------------------------------*/
+
+INT interrupt_configure(INT cmd, INT source, PTYPE adr)
+{
+  switch (cmd) {
+  case CMD_INTERRUPT_ENABLE:
+    break;
+  case CMD_INTERRUPT_DISABLE:
+    break;
+  case CMD_INTERRUPT_ATTACH:
+    break;
+  case CMD_INTERRUPT_DETACH:
+    break;
+  }
+  return SUCCESS;
+}
+
+//--- Event readout -------------------------------------------------*/
+
+// Reduce the boards of a family to features at pfeat, and decide if
+// its traces are kept.  Returns the end of the features written.
+template <typename T>
+float *extract_features(std::vector<T> &boards, family_output &fam,
+                        float *pfeat, unsigned long long num_events)
+{
+  auto pf = (util::pulse_features *)pfeat;
+  bool anomalous = false;
+
+  fam.keep_traces = true;
+
+  if (!fam.features.enabled) {
+    return pfeat;
+  }
+
+  for (auto &sis : boards) {
+
+    util::ExtractFeatures(&sis.trace[0][0], fam.num_ch, fam.len,
+                          fam.features.baseline_samples, pf);
+
+    anomalous |= util::IsAnomalous(pf, fam.num_ch, fam.features);
+    pf += fam.num_ch;
+  }
+
+  fam.keep_traces = anomalous || (fam.features.trace_prescale > 0 &&
+                                  num_events % fam.features.trace_prescale
+                                  == 0);
+
+  return (float *)pf;
+}
+
+// One bank per board, zero-suppressed where that pays off.
+template <typename T>
+void write_trace_banks(char *pevent, std::vector<T> &boards,
+                       family_output &fam)
+{
+  char bk_name[10];
+  WORD *pdata;
+  int count = 0;
+  const int dense_words = fam.num_ch * fam.len;
+
+  trace_bytes_total += boards.size() * sizeof(boards[0].trace);
+
+  if (!fam.keep_traces) {
+    return;
+  }
+
+  fam.zero_suppress.threshold = global_param.adc_threshold;
+
+  for (auto &sis : boards) {
+
+    int num_words = dense_words;
+
+    if (fam.zero_suppress.enabled) {
+      num_words = util::ZeroSuppress(&sis.trace[0][0], fam.num_ch, fam.len,
+                                     fam.zero_suppress, &fam.zs_buffer[0]);
+    }
+
+    // Fall back to the dense bank if suppression does not pay off.
+    if (num_words < dense_words) {
+
+      sprintf(bk_name, "%s%01i", fam.zs_bank, count++);
+      bk_create(pevent, bk_name, TID_WORD, &pdata);
+      pdata = std::copy(&fam.zs_buffer[0], &fam.zs_buffer[0] + num_words,
+                        pdata);
+      bk_close(pevent, pdata);
+
+    } else {
+
+      num_words = dense_words;
+      sprintf(bk_name, "%s%01i", fam.bank, count++);
+      bk_create(pevent, bk_name, TID_WORD, &pdata);
+      pdata = std::copy(&sis.trace[0][0], &sis.trace[0][0] + dense_words,
+                        pdata);
+      bk_close(pevent, pdata);
+    }
+
+    trace_bytes_written += num_words * sizeof(WORD);
+  }
+}
+
+INT read_trigger_event(char *pevent, INT off)
+{
+  using namespace daq;
+  static unsigned long long num_events;
+
+  float *pfeat;
+
+  jitter.MarkReadout();
+
+  // Copy the data, one event holds every board of the crate, but no
+  // more boards than the run was set up for.
+  auto &event = event_manager->GetCurrentEvent();
+  size_t num_3316 = std::min(event.sis_3316_vec.size(),
+                             data.sis_3316_vec.size());
+  size_t num_3302 = std::min(event.sis_3302_vec.size(),
+                             data.sis_3302_vec.size());
+  std::copy(event.sis_3316_vec.begin(), event.sis_3316_vec.begin() + num_3316,
+            data.sis_3316_vec.begin());
+  std::copy(event.sis_3302_vec.begin(), event.sis_3302_vec.begin() + num_3302,
+            data.sis_3302_vec.begin());
+
+  // Pop the event now that we are done copying it.
+  event_manager->PopCurrentEvent();
+  num_events++;
+
+  // ROOT output, both trees get an entry at every trigger.
+  if (run_in_progress && write_root) {
+    t_sis3316->Fill();
+    t_sis3302->Fill();
+  }
+
+  bk_init32(pevent);
+
+  if (!write_midas) {
+    return bk_size(pevent);
+  }
+
+  // Reduce every channel to a few features, the SIS3316 boards first.
+  // Traces of a family are then only kept for prescaled or anomalous
+  // events.
+  if (out_sis3316.features.enabled || out_sis3302.features.enabled) {
+
+    bk_create(pevent, "FEAT", TID_FLOAT, &pfeat);
+    pfeat = extract_features(data.sis_3316_vec, out_sis3316, pfeat,
+                             num_events);
+    pfeat = extract_features(data.sis_3302_vec, out_sis3302, pfeat,
+                             num_events);
+    bk_close(pevent, pfeat);
+  }
+
+  // And the traces.
+  write_trace_banks(pevent, data.sis_3316_vec, out_sis3316);
+  write_trace_banks(pevent, data.sis_3302_vec, out_sis3302);
+
+  return bk_size(pevent);
+}
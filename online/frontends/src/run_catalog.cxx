@@ -0,0 +1,128 @@
+/*---------------------------------------------------------------------------*\
+file:   run_catalog.cxx
+
+about:  Command line access to the run catalog kept by the online monitor
+        in <log dir>/runlog.sqlite.  Prints matching runs as a table or,
+        with --json, in the same format the ODB query service returns.
+
+usage:  run_catalog <runlog.sqlite> [--run N] [--tag TAG]
+                    [--from YYYY-MM-DD[ HH:MM]] [--to YYYY-MM-DD[ HH:MM]]
+                    [--limit N] [--json]
+
+\*---------------------------------------------------------------------------*/
+
+//-- std includes ------------------------------------------------------------//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+//--- project includes -------------------------------------------------------//
+#include "util/run_log.hh"
+
+int usage(const char *name)
+{
+  printf("usage: %s <runlog.sqlite> [--run N] [--tag TAG] [--from DATE] "
+         "[--to DATE] [--limit N] [--json]\n", name);
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    return usage(argv[0]);
+  }
+
+  util::run_query query;
+  query.from = 0;
+  query.to = 0;
+  query.limit = 0;
+
+  int run = -1;
+  bool json = false;
+
+  for (int i = 2; i < argc; ++i) {
+    std::string arg(argv[i]);
+
+    if (arg == "--json") {
+      json = true;
+      continue;
+    }
+
+    if (i + 1 == argc) {
+      return usage(argv[0]);
+    }
+
+    std::string val(argv[++i]);
+
+    if (arg == "--run") {
+      run = atoi(val.c_str());
+
+    } else if (arg == "--tag") {
+      query.tag = val;
+
+    } else if (arg == "--from" || arg == "--to") {
+      long long t = util::ParseDate(val);
+
+      if (t < 0) {
+        printf("could not parse date '%s'\n", val.c_str());
+        return 1;
+      }
+
+      if (arg == "--from") {
+        query.from = t;
+      } else {
+        query.to = t;
+      }
+
+    } else if (arg == "--limit") {
+      query.limit = atoi(val.c_str());
+
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  util::RunLog run_log;
+
+  if (!run_log.Open(argv[1])) {
+    printf("could not open %s: %s\n", argv[1], run_log.error().c_str());
+    return 1;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<util::run_entry> entries;
+
+  if (run >= 0) {
+    entries.resize(1);
+    if (!run_log.Find(run, entries[0])) entries.clear();
+
+  } else {
+    entries = run_log.Query(query);
+  }
+
+  auto t1 = std::chrono::steady_clock::now();
+
+  if (json) {
+    printf("%s\n", util::ToJson(entries).c_str());
+    return 0;
+  }
+
+  for (auto &entry : entries) {
+    std::string tags;
+
+    for (auto &tag : entry.tags) {
+      tags += (tags.empty() ? "" : ",") + tag;
+    }
+
+    printf("%6i  %-24s  %-24s  %9lli  %-20s  %s\n", entry.run,
+           entry.start_time.c_str(), entry.stop_time.c_str(),
+           entry.events, tags.c_str(), entry.comment.c_str());
+  }
+
+  printf("%zu runs in %.2f ms\n", entries.size(),
+         std::chrono::duration<double>(t1 - t0).count() * 1.0e3);
+
+  return 0;
+}
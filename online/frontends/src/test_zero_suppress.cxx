@@ -0,0 +1,115 @@
+/*---------------------------------------------------------------------------*\
+file:   test_zero_suppress.cxx
+
+about:  Checks the sparse stream of util::ZeroSuppress against the
+        ZeroSuppressMaxWords bound the frontends size their buffers
+        with, on the worst cases: a crossing on every other sample and
+        on every sample, with and without pre and post samples, and
+        negative window sizes.  Words past the bound are caught with a
+        guard pattern.  Every stream must also decode back to traces
+        that keep each crossing sample.  Exits non-zero on a failure.
+
+usage:  test_zero_suppress
+
+\*---------------------------------------------------------------------------*/
+
+//-- std includes ------------------------------------------------------------//
+#include <stdio.h>
+#include <vector>
+#include <random>
+
+//--- project includes -------------------------------------------------------//
+#include "util/zero_suppress.hh"
+
+const int kNumCh = 4;
+const unsigned short kGuard = 0xdead;
+const int kGuardWords = 4096;
+
+// Suppress the traces, returns false and says why if something is off.
+bool Check(const char *name, const std::vector<unsigned short>& traces,
+           int len, int pre, int post)
+{
+  util::zs_config conf;
+  conf.enabled = true;
+  conf.threshold = 10.0;
+  conf.pre_samples = pre;
+  conf.post_samples = post;
+  conf.baseline_samples = 1;
+
+  int bound = util::ZeroSuppressMaxWords(kNumCh, len);
+  std::vector<unsigned short> out(bound + kGuardWords, kGuard);
+
+  int num_words = util::ZeroSuppress(&traces[0], kNumCh, len, conf, &out[0]);
+  bool ok = true;
+
+  for (int i = bound; i < (int)out.size(); ++i) {
+    if (out[i] != kGuard) {
+      ok = false;
+      break;
+    }
+  }
+
+  if (!ok || num_words > bound) {
+    printf("FAIL %-28s len %4i pre %3i post %3i: %i words, bound %i\n",
+           name, len, pre, post, num_words, bound);
+    return false;
+  }
+
+  // Crossings are 100 counts off the baseline, they have to come back.
+  std::vector<unsigned short> decoded(kNumCh * len);
+
+  if (!util::ZeroSuppressDecode(&out[0], num_words, kNumCh, len,
+                                &decoded[0])) {
+    printf("FAIL %-28s len %4i pre %3i post %3i: does not decode\n",
+           name, len, pre, post);
+    return false;
+  }
+
+  for (int i = 0; i < kNumCh * len; ++i) {
+    if (traces[i] != traces[(i / len) * len] && decoded[i] != traces[i]) {
+      printf("FAIL %-28s len %4i pre %3i post %3i: sample %i lost\n",
+             name, len, pre, post, i);
+      return false;
+    }
+  }
+
+  printf("ok   %-28s len %4i pre %3i post %3i: %6i words, bound %6i\n",
+         name, len, pre, post, num_words, bound);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  const int lens[] = {1, 2, 7, 1024, 1025};
+  const int windows[][2] = {{0, 0}, {16, 0}, {0, 64}, {16, 64}, {3, 1},
+                            {-5, 0}, {0, -5}, {-16, -64}};
+  int failed = 0;
+  std::mt19937 gen(42);
+
+  for (int len : lens) {
+
+    // The first sample of each channel sets the baseline.
+    std::vector<unsigned short> alternating(kNumCh * len, 1000);
+    std::vector<unsigned short> all_crossing(kNumCh * len, 1100);
+    std::vector<unsigned short> random(kNumCh * len, 1000);
+
+    for (int ch = 0; ch < kNumCh; ++ch) {
+      for (int i = 1; i < len; ++i) {
+        alternating[ch * len + i] = (i % 2) ? 1100 : 1000;
+        random[ch * len + i] = (gen() % 3 == 0) ? 1100 : 1000;
+      }
+
+      all_crossing[ch * len] = 1000;
+    }
+
+    for (auto &w : windows) {
+      failed += !Check("alternating samples", alternating, len, w[0], w[1]);
+      failed += !Check("every sample crossing", all_crossing, len,
+                       w[0], w[1]);
+      failed += !Check("random crossings", random, len, w[0], w[1]);
+    }
+  }
+
+  printf("%s, %i failed\n", failed ? "FAILED" : "passed", failed);
+  return failed ? 1 : 0;
+}
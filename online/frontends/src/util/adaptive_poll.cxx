@@ -0,0 +1,159 @@
+#include "util/adaptive_poll.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <stdio.h>
+#include <thread>
+#include <algorithm>
+
+namespace util {
+
+namespace {
+
+inline double ElapsedUs(std::chrono::steady_clock::time_point t0,
+                        std::chrono::steady_clock::time_point t1)
+{
+  return std::chrono::duration<double, std::micro>(t1 - t0).count();
+}
+
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+} // ::(anonymous)
+
+AdaptivePoller::AdaptivePoller() : detect_(1.0, 20000)
+{
+  Reset();
+}
+
+void AdaptivePoller::set_policy(const poll_policy& policy)
+{
+  policy_ = policy;
+  policy_.min_sleep_us = std::max(policy_.min_sleep_us, 1.0);
+  policy_.max_sleep_us = std::max(policy_.max_sleep_us,
+                                  policy_.min_sleep_us);
+  sleep_us_ = policy_.min_sleep_us;
+}
+
+void AdaptivePoller::Reset()
+{
+  detect_.Reset();
+  have_event_ = false;
+  have_miss_ = false;
+  mean_interval_us_ = 0.0;
+  sleep_us_ = policy_.min_sleep_us;
+  busy_us_ = 0.0;
+  idle_us_ = 0.0;
+  parks_ = 0;
+}
+
+bool AdaptivePoller::Wait(const std::function<bool()>& has_event)
+{
+  // The window counts from entry, sleeping doesn't extend it.
+  auto t = clock::now();
+  auto deadline = t + std::chrono::duration_cast<clock::duration>(
+    std::chrono::duration<double, std::milli>(policy_.window_ms));
+  auto busy_from = t;
+
+  while (true) {
+
+    if (has_event()) {
+      t = clock::now();
+
+      // Only an empty check just before makes a fair bound.
+      if (have_miss_) {
+        detect_.Fill(ElapsedUs(last_miss_, t));
+      }
+
+      if (have_event_) {
+        double dt = ElapsedUs(last_event_, t);
+
+        if (mean_interval_us_ == 0.0) {
+          mean_interval_us_ = dt;
+        } else {
+          mean_interval_us_ += 0.05 * (dt - mean_interval_us_);
+        }
+      }
+
+      busy_us_ += ElapsedUs(busy_from, t);
+      last_event_ = t;
+      have_event_ = true;
+      have_miss_ = false;
+      sleep_us_ = policy_.min_sleep_us;
+
+      return true;
+    }
+
+    t = clock::now();
+    last_miss_ = t;
+    have_miss_ = true;
+
+    if (!policy_.adaptive || t >= deadline) {
+      busy_us_ += ElapsedUs(busy_from, t);
+      return false;
+    }
+
+    double left_us = ElapsedUs(t, deadline);
+    double quiet_us = have_event_ ? ElapsedUs(last_event_, t) : 1.0e12;
+
+    if (quiet_us < policy_.spin_us) {
+      CpuRelax();
+      continue;
+    }
+
+    double nap_us;
+
+    if (quiet_us > policy_.park_after_ms * 1.0e3) {
+      nap_us = policy_.park_us;
+      ++parks_;
+
+    } else {
+      // Sleep no longer than a fraction of the usual gap between events.
+      double cap_us = policy_.max_sleep_us;
+
+      if (mean_interval_us_ > 0.0) {
+        cap_us = std::min(cap_us, std::max(mean_interval_us_ / 8,
+                                           policy_.min_sleep_us));
+      }
+
+      nap_us = std::min(sleep_us_, cap_us);
+      sleep_us_ = std::min(sleep_us_ * 2, cap_us);
+    }
+
+    nap_us = std::min(nap_us, left_us);
+
+    auto t0 = clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(
+                                  nap_us));
+    auto t1 = clock::now();
+
+    busy_us_ += ElapsedUs(busy_from, t0);
+    idle_us_ += ElapsedUs(t0, t1);
+    busy_from = t1;
+  }
+}
+
+double AdaptivePoller::busy_fraction() const
+{
+  double total = busy_us_ + idle_us_;
+  return (total > 0.0) ? busy_us_ / total : 0.0;
+}
+
+std::string AdaptivePoller::Report() const
+{
+  char str[256];
+
+  snprintf(str, sizeof(str), "poll: %s, detect p50 %.1f us, p99 %.1f us, "
+           "max %.1f us, busy %.1f%%, %llu parks, mean gap %.1f us",
+           policy_.adaptive ? "adaptive" : "single check",
+           detect_.Percentile(0.5), detect_.Percentile(0.99),
+           detect_.max_us(), 100.0 * busy_fraction(), parks_,
+           mean_interval_us_);
+
+  return std::string(str);
+}
+
+} // ::util
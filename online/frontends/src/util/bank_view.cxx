@@ -0,0 +1,37 @@
+#include "util/bank_view.hh"
+
+//--- other includes --------------------------------------------------------//
+#include "midas.h"
+
+namespace util {
+
+TraceView<uint16_t> LocateTraces(void *pevent, const char *name, int num_ch,
+                                 bool *rejected)
+{
+  DWORD num_words = 0;
+  DWORD type = 0;
+  void *pdata = nullptr;
+
+  if (rejected != nullptr) {
+    *rejected = false;
+  }
+
+  // bk_find gives the length in elements of the bank type.
+  if (!bk_find((BANK_HEADER *)pevent, name, &num_words, &type, &pdata)) {
+    return TraceView<uint16_t>();
+  }
+
+  TraceView<uint16_t> view;
+
+  if (type == TID_WORD) {
+    view = TraceView<uint16_t>((const uint16_t *)pdata, num_words, num_ch);
+  }
+
+  if (!view && rejected != nullptr) {
+    *rejected = true;
+  }
+
+  return view;
+}
+
+} // ::util
@@ -0,0 +1,122 @@
+#include "util/channel_stats.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <cmath>
+#include <algorithm>
+
+namespace util {
+
+void running_stats::Add(double x)
+{
+  double delta = x - mean;
+
+  ++n;
+  mean += delta / n;
+  m2 += delta * (x - mean);
+}
+
+void running_stats::Merge(long long n_b, double mean_b, double m2_b)
+{
+  if (n_b == 0) return;
+
+  long long n_ab = n + n_b;
+  double delta = mean_b - mean;
+
+  mean += delta * n_b / n_ab;
+  m2 += m2_b + delta * delta * ((double)n * n_b / n_ab);
+  n = n_ab;
+}
+
+double running_stats::rms() const
+{
+  return (n > 1) ? sqrt(m2 / (n - 1)) : 0.0;
+}
+
+ChannelStats::ChannelStats(int num_ch, int trace_len, int baseline_len,
+                           double threshold) :
+  num_ch_(num_ch), trace_len_(trace_len),
+  baseline_len_(std::min(std::max(baseline_len, 1), trace_len)),
+  threshold_(threshold)
+{
+  Clear();
+}
+
+void ChannelStats::set_threshold(double threshold)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  threshold_ = threshold;
+}
+
+void ChannelStats::Fill(const uint16_t *traces)
+{
+  // Reduce each trace first, the lock only covers the merge.
+  static thread_local std::vector<running_stats> window;
+  static thread_local std::vector<uint16_t> lo, hi;
+
+  window.assign(num_ch_, running_stats());
+  lo.resize(num_ch_);
+  hi.resize(num_ch_);
+
+  for (int ch = 0; ch < num_ch_; ++ch) {
+    const uint16_t *trace = traces + (size_t)ch * trace_len_;
+
+    for (int i = 0; i < baseline_len_; ++i) {
+      window[ch].Add(trace[i]);
+    }
+
+    auto range = std::minmax_element(trace, trace + trace_len_);
+    lo[ch] = *range.first;
+    hi[ch] = *range.second;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (int ch = 0; ch < num_ch_; ++ch) {
+    baseline_[ch].Merge(window[ch].n, window[ch].mean, window[ch].m2);
+    min_[ch] = std::min(min_[ch], lo[ch]);
+    max_[ch] = std::max(max_[ch], hi[ch]);
+
+    if (hi[ch] - window[ch].mean > threshold_) {
+      ++hits_[ch];
+    }
+  }
+
+  ++num_events_;
+}
+
+void ChannelStats::Take(std::vector<channel_summary>& channels,
+                        double& event_rate)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto now = std::chrono::steady_clock::now();
+  double dt = std::chrono::duration<double>(now - start_).count();
+
+  channels.resize(num_ch_);
+
+  for (int ch = 0; ch < num_ch_; ++ch) {
+    channel_summary& sum = channels[ch];
+
+    sum.baseline = baseline_[ch].mean;
+    sum.rms = baseline_[ch].rms();
+    sum.min = (num_events_ > 0) ? min_[ch] : 0.0;
+    sum.max = (num_events_ > 0) ? max_[ch] : 0.0;
+    sum.rate = (dt > 0.0) ? hits_[ch] / dt : 0.0;
+  }
+
+  event_rate = (dt > 0.0) ? num_events_ / dt : 0.0;
+
+  Clear();
+}
+
+void ChannelStats::Clear()
+{
+  num_events_ = 0;
+  baseline_.assign(num_ch_, running_stats());
+  min_.assign(num_ch_, UINT16_MAX);
+  max_.assign(num_ch_, 0);
+  hits_.assign(num_ch_, 0);
+  start_ = std::chrono::steady_clock::now();
+}
+
+} // ::util
@@ -0,0 +1,177 @@
+#include "util/config_store.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <fstream>
+#include <cstdio>
+#include <sys/stat.h>
+
+//--- other includes --------------------------------------------------------//
+#include "boost/property_tree/json_parser.hpp"
+
+namespace util {
+
+std::string ContentHash(const std::string& data)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+
+  char str[32];
+  sprintf(str, "%016llx", hash);
+  return std::string(str);
+}
+
+ConfigStore::ConfigStore(const std::string& store_dir)
+{
+  store_dir_ = store_dir;
+
+  if (store_dir_.size() > 0 && store_dir_[store_dir_.size() - 1] != '/') {
+    store_dir_ += "/";
+  }
+
+  mkdir(store_dir_.c_str(), 0755);
+}
+
+void ConfigStore::Archive(const std::string& name, const std::string& conf_dir,
+                          const std::string& file,
+                          boost::property_tree::ptree &manifest)
+{
+  AddToManifest(name, conf_dir, file, manifest);
+
+  for (auto &ref : References(conf_dir + file)) {
+    AddToManifest(ref.first, conf_dir, ref.second, manifest);
+  }
+}
+
+std::string ConfigStore::Add(const std::string& path)
+{
+  entry *e = Lookup(path);
+  return (e == nullptr) ? std::string() : e->hash;
+}
+
+bool ConfigStore::Load(const std::string& hash,
+                       boost::property_tree::ptree &conf)
+{
+  try {
+    boost::property_tree::read_json(BlobPath(hash), conf);
+
+  } catch (...) {
+    return false;
+  }
+
+  return true;
+}
+
+ConfigStore::entry *ConfigStore::Lookup(const std::string& path)
+{
+  struct stat st;
+
+  if (stat(path.c_str(), &st) != 0) {
+    return nullptr;
+  }
+
+  long long mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  auto it = cache_.find(path);
+
+  if (it != cache_.end() && it->second.mtime_ns == mtime_ns &&
+      it->second.size == st.st_size) {
+    return &it->second;
+  }
+
+  // Read the size stat saw, a file that changes meanwhile is retried
+  // the next time round.
+  std::ifstream in(path, std::ios::binary);
+  std::string data(st.st_size, '\0');
+
+  if (!in.is_open() || !in.read(&data[0], data.size())) {
+    cache_.erase(path);
+    return nullptr;
+  }
+
+  std::string hash = ContentHash(data);
+
+  // Write new content next to the blob and rename, so a crash never
+  // leaves a truncated file under a valid hash.
+  std::string blob = BlobPath(hash);
+
+  if (stat(blob.c_str(), &st) != 0) {
+    std::string tmp = blob + ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+    out << data;
+    out.close();
+
+    if (!out.good() || rename(tmp.c_str(), blob.c_str()) != 0) {
+      remove(tmp.c_str());
+      cache_.erase(path);
+      return nullptr;
+    }
+  }
+
+  // Only cached once the blob is there, a failed write is retried.
+  entry &e = cache_[path];
+  e.mtime_ns = mtime_ns;
+  e.size = data.size();
+  e.hash = hash;
+  e.refs_parsed = false;
+  e.refs.clear();
+
+  return &e;
+}
+
+const ConfigStore::ref_list &ConfigStore::References(const std::string& path)
+{
+  static const ref_list none;
+  entry *e = Lookup(path);
+
+  if (e == nullptr) {
+    return none;
+  }
+
+  if (e->refs_parsed) {
+    return e->refs;
+  }
+
+  e->refs_parsed = true;
+  boost::property_tree::ptree conf;
+
+  if (!Load(e->hash, conf)) {
+    return e->refs;
+  }
+
+  auto devices = conf.get_child_optional("devices");
+
+  if (devices) {
+    for (auto &dev_type : *devices) {
+      for (auto &dev : dev_type.second) {
+        if (dev.second.data().find("json") != std::string::npos) {
+          e->refs.push_back(std::make_pair(dev.first, dev.second.data()));
+        }
+      }
+    }
+  }
+
+  for (auto &val : conf) {
+    if (val.second.data().find("json") != std::string::npos) {
+      e->refs.push_back(std::make_pair(val.first, val.second.data()));
+    }
+  }
+
+  return e->refs;
+}
+
+void ConfigStore::AddToManifest(const std::string& name,
+                                const std::string& conf_dir,
+                                const std::string& file,
+                                boost::property_tree::ptree &manifest)
+{
+  boost::property_tree::ptree pt;
+  pt.put("file", file);
+  pt.put("hash", Add(conf_dir + file));
+
+  manifest.put_child(boost::property_tree::ptree::path_type(name, '\0'), pt);
+}
+
+} // ::util
@@ -0,0 +1,246 @@
+#include "util/convert.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <cstring>
+
+//--- other includes --------------------------------------------------------//
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMPLE_DAQ_HAVE_AVX2_KERNELS 1
+#endif
+
+namespace util {
+
+namespace {
+
+//--- scalar kernels --------------------------------------------------------//
+
+void WidenU16Scalar(const uint16_t *src, size_t n, double *dst)
+{
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = src[i];
+  }
+}
+
+void ScaleU16Scalar(const uint16_t *src, size_t n, double scale,
+                    double offset, double *dst)
+{
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = src[i] * scale + offset;
+  }
+}
+
+void ScaleI16BytesScalar(const char *src, size_t n, bool big_endian,
+                         double scale, double offset, double *dst)
+{
+  const unsigned char *p = (const unsigned char *)src;
+
+  for (size_t i = 0; i < n; ++i, p += 2) {
+    int16_t x;
+
+    if (big_endian) {
+      x = (int16_t)((p[0] << 8) | p[1]);
+    } else {
+      x = (int16_t)((p[1] << 8) | p[0]);
+    }
+
+    dst[i] = x * scale + offset;
+  }
+}
+
+void RampScalar(size_t n, double offset, double step, double *dst)
+{
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = offset + i * step;
+  }
+}
+
+//--- AVX2 kernels, 8 samples per step --------------------------------------//
+#ifdef SIMPLE_DAQ_HAVE_AVX2_KERNELS
+
+__attribute__((target("avx2")))
+inline void Store8(__m256i x, double *dst)
+{
+  __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(x));
+  __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1));
+
+  _mm256_storeu_pd(dst, lo);
+  _mm256_storeu_pd(dst + 4, hi);
+}
+
+__attribute__((target("avx2")))
+inline void Store8(__m256i x, __m256d scale, __m256d offset, double *dst)
+{
+  __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(x));
+  __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1));
+
+  _mm256_storeu_pd(dst, _mm256_add_pd(_mm256_mul_pd(lo, scale), offset));
+  _mm256_storeu_pd(dst + 4, _mm256_add_pd(_mm256_mul_pd(hi, scale), offset));
+}
+
+__attribute__((target("avx2")))
+void WidenU16Avx2(const uint16_t *src, size_t n, double *dst)
+{
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+    Store8(_mm256_cvtepu16_epi32(x), dst + i);
+  }
+
+  WidenU16Scalar(src + i, n - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+void ScaleU16Avx2(const uint16_t *src, size_t n, double scale, double offset,
+                  double *dst)
+{
+  __m256d s = _mm256_set1_pd(scale);
+  __m256d o = _mm256_set1_pd(offset);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+    Store8(_mm256_cvtepu16_epi32(x), s, o, dst + i);
+  }
+
+  ScaleU16Scalar(src + i, n - i, scale, offset, dst + i);
+}
+
+__attribute__((target("avx2")))
+void ScaleI16BytesAvx2(const char *src, size_t n, bool big_endian,
+                       double scale, double offset, double *dst)
+{
+  const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                     9, 8, 11, 10, 13, 12, 15, 14);
+  __m256d s = _mm256_set1_pd(scale);
+  __m256d o = _mm256_set1_pd(offset);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+
+    if (big_endian) {
+      x = _mm_shuffle_epi8(x, swap);
+    }
+
+    Store8(_mm256_cvtepi16_epi32(x), s, o, dst + i);
+  }
+
+  ScaleI16BytesScalar(src + 2 * i, n - i, big_endian, scale, offset, dst + i);
+}
+
+__attribute__((target("avx2")))
+void RampAvx2(size_t n, double offset, double step, double *dst)
+{
+  __m256d s = _mm256_set1_pd(step);
+  __m256d o = _mm256_set1_pd(offset);
+  __m256d idx = _mm256_setr_pd(0.0, 1.0, 2.0, 3.0);
+  __m256d four = _mm256_set1_pd(4.0);
+  size_t i = 0;
+
+  // Indices stay exact in double, so this matches offset + i * step.
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(dst + i, _mm256_add_pd(o, _mm256_mul_pd(idx, s)));
+    idx = _mm256_add_pd(idx, four);
+  }
+
+  for (; i < n; ++i) {
+    dst[i] = offset + i * step;
+  }
+}
+
+#endif
+
+//--- dispatch --------------------------------------------------------------//
+
+struct kernels {
+  const char *isa;
+  void (*widen_u16)(const uint16_t *, size_t, double *);
+  void (*scale_u16)(const uint16_t *, size_t, double, double, double *);
+  void (*scale_i16_bytes)(const char *, size_t, bool, double, double,
+                          double *);
+  void (*ramp)(size_t, double, double, double *);
+};
+
+const kernels kScalar = {"scalar", WidenU16Scalar, ScaleU16Scalar,
+                         ScaleI16BytesScalar, RampScalar};
+
+#ifdef SIMPLE_DAQ_HAVE_AVX2_KERNELS
+const kernels kAvx2 = {"avx2", WidenU16Avx2, ScaleU16Avx2,
+                       ScaleI16BytesAvx2, RampAvx2};
+#endif
+
+bool HasAvx2()
+{
+#ifdef SIMPLE_DAQ_HAVE_AVX2_KERNELS
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+const kernels *Best()
+{
+#ifdef SIMPLE_DAQ_HAVE_AVX2_KERNELS
+  if (HasAvx2()) return &kAvx2;
+#endif
+
+  return &kScalar;
+}
+
+// Resolved on first use, so static initializers elsewhere can convert.
+const kernels *&Active()
+{
+  static const kernels *active = Best();
+  return active;
+}
+
+} // ::(anonymous)
+
+void WidenU16(const uint16_t *src, size_t n, double *dst)
+{
+  Active()->widen_u16(src, n, dst);
+}
+
+void ScaleU16(const uint16_t *src, size_t n, double scale, double offset,
+              double *dst)
+{
+  Active()->scale_u16(src, n, scale, offset, dst);
+}
+
+void ScaleI16Bytes(const char *src, size_t n, bool big_endian, double scale,
+                   double offset, double *dst)
+{
+  Active()->scale_i16_bytes(src, n, big_endian, scale, offset, dst);
+}
+
+void Ramp(size_t n, double offset, double step, double *dst)
+{
+  Active()->ramp(n, offset, step, dst);
+}
+
+const char *ConvertIsa()
+{
+  return Active()->isa;
+}
+
+bool SetConvertIsa(const std::string& isa)
+{
+  if (isa == "scalar") {
+    Active() = &kScalar;
+    return true;
+  }
+
+#ifdef SIMPLE_DAQ_HAVE_AVX2_KERNELS
+  if (isa == "avx2" && HasAvx2()) {
+    Active() = &kAvx2;
+    return true;
+  }
+#endif
+
+  return false;
+}
+
+} // ::util
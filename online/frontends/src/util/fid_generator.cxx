@@ -0,0 +1,50 @@
+#include "util/fid_generator.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <cmath>
+#include <algorithm>
+
+namespace util {
+
+fid_config DefaultFidConfig()
+{
+  fid_config conf;
+  conf.sample_rate = 10.0e6;
+  conf.frequency = 50.0e3;
+  conf.t2 = 5.0e-3;
+  conf.amplitude = 4000.0;
+  conf.baseline = 8192.0;
+  conf.noise = 5.0;
+  conf.start = 1.0e-4;
+  conf.max_adc = 16383.0;
+
+  return conf;
+}
+
+FidGenerator::FidGenerator(unsigned int seed) :
+  rng_(seed), gaus_(0.0, 1.0), flat_(0.0, 1.0)
+{
+}
+
+void FidGenerator::Fill(unsigned short *trace, int len,
+                        const fid_config &conf)
+{
+  const double dt = 1.0 / conf.sample_rate;
+  const double w = 2 * M_PI * conf.frequency;
+  double amp = conf.amplitude * (1.0 + 0.01 * gaus_(rng_));
+  double phi = 2 * M_PI * flat_(rng_);
+
+  for (int i = 0; i < len; ++i) {
+
+    double t = i * dt - conf.start;
+    double val = conf.baseline + conf.noise * gaus_(rng_);
+
+    if (t >= 0.0) {
+      val += amp * std::exp(-t / conf.t2) * std::sin(w * t + phi);
+    }
+
+    trace[i] = (unsigned short)std::max(0.0, std::min(val, conf.max_adc));
+  }
+}
+
+} // ::util
@@ -0,0 +1,204 @@
+#include "util/file_pipeline.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//--- other includes --------------------------------------------------------//
+#include <zlib.h>
+
+namespace util {
+
+namespace {
+
+const size_t kChunkSize = 1 << 20;
+
+std::string BaseName(const std::string& path)
+{
+  size_t pos = path.rfind('/');
+
+  if (pos == std::string::npos) {
+    return path;
+  }
+
+  return path.substr(pos + 1);
+}
+
+// Copy with the CRC-32 of what was read, fsync'd before returning.
+bool CopyFile(const std::string& src, const std::string& dst,
+              unsigned long& crc, std::string& error)
+{
+  int in = open(src.c_str(), O_RDONLY);
+
+  if (in < 0) {
+    error = src + ": " + strerror(errno);
+    return false;
+  }
+
+  int out = open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+  if (out < 0) {
+    error = dst + ": " + strerror(errno);
+    close(in);
+    return false;
+  }
+
+  std::vector<char> buf(kChunkSize);
+  ssize_t n;
+  bool ok = true;
+  crc = crc32(0L, Z_NULL, 0);
+
+  while ((n = read(in, buf.data(), buf.size())) > 0) {
+    crc = crc32(crc, (const Bytef *)buf.data(), n);
+
+    for (ssize_t done = 0; done < n; ) {
+      ssize_t m = write(out, buf.data() + done, n - done);
+
+      if (m < 0) {
+        ok = false;
+        break;
+      }
+
+      done += m;
+    }
+
+    if (!ok) break;
+  }
+
+  if (n < 0 || !ok || fsync(out) != 0) {
+    error = dst + ": " + strerror(errno);
+    ok = false;
+  }
+
+  close(in);
+  close(out);
+
+  if (!ok) {
+    unlink(dst.c_str());
+  }
+
+  return ok;
+}
+
+} // ::(anonymous)
+
+archive_mode ParseArchiveMode(const std::string& mode)
+{
+  if (mode == "link") {
+    return kArchiveLink;
+
+  } else if (mode == "move") {
+    return kArchiveMove;
+  }
+
+  return kArchiveNone;
+}
+
+bool FileCrc32(const std::string& path, unsigned long& crc)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+
+  if (fd < 0) {
+    return false;
+  }
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  std::vector<char> buf(kChunkSize);
+  ssize_t n;
+  crc = crc32(0L, Z_NULL, 0);
+
+  while ((n = read(fd, buf.data(), buf.size())) > 0) {
+    crc = crc32(crc, (const Bytef *)buf.data(), n);
+  }
+
+  close(fd);
+
+  return n == 0;
+}
+
+bool WriteCrc32File(const std::string& path, unsigned long crc)
+{
+  FILE *f = fopen((path + ".crc32").c_str(), "w");
+
+  if (f == nullptr) {
+    return false;
+  }
+
+  fprintf(f, "%08lx  %s\n", crc, BaseName(path).c_str());
+
+  return fclose(f) == 0;
+}
+
+bool RemoveFiles(const std::vector<std::string>& paths, std::string& error)
+{
+  bool ok = true;
+
+  for (auto &path : paths) {
+    if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+      error += (ok ? "" : ", ") + path + ": " + strerror(errno);
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+std::string ArchiveFile(const std::string& path, const std::string& dir,
+                        archive_mode mode, std::string& error)
+{
+  if (mode == kArchiveNone) {
+    return path;
+  }
+
+  std::string dst = dir;
+
+  if (dst.size() > 0 && dst[dst.size() - 1] != '/') {
+    dst += "/";
+  }
+
+  dst += BaseName(path);
+
+  if (mode == kArchiveLink) {
+    if (link(path.c_str(), dst.c_str()) != 0) {
+      error = dst + ": " + strerror(errno);
+      return std::string();
+    }
+
+    return dst;
+  }
+
+  // A move is a link and an unlink, unlike rename it won't replace a
+  // file already in the archive.
+  if (link(path.c_str(), dst.c_str()) == 0) {
+    unlink(path.c_str());
+    return dst;
+
+  } else if (errno != EXDEV && errno != EPERM) {
+    error = dst + ": " + strerror(errno);
+    return std::string();
+  }
+
+  // Another filesystem, the original goes once the copy checks out.
+  unsigned long crc_src, crc_dst;
+
+  if (!CopyFile(path, dst, crc_src, error)) {
+    return std::string();
+  }
+
+  if (!FileCrc32(dst, crc_dst) || crc_src != crc_dst) {
+    error = dst + ": checksum differs from " + path;
+    unlink(dst.c_str());
+    return std::string();
+  }
+
+  unlink(path.c_str());
+
+  return dst;
+}
+
+} // ::util
@@ -0,0 +1,266 @@
+#include "util/param_cache.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+namespace util {
+
+ParamCache::ParamCache() : hdb_(0)
+{
+}
+
+ParamCache::~ParamCache()
+{
+}
+
+std::string ParamCache::String(const std::string& key, const std::string& def)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Link(key, TID_STRING, def)->str;
+}
+
+double ParamCache::Double(const std::string& key, double def)
+{
+  char str[32];
+  snprintf(str, sizeof(str), "%.17g", def);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Link(key, TID_DOUBLE, str)->num;
+}
+
+int ParamCache::Int(const std::string& key, int def)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Link(key, TID_INT, std::to_string(def))->num;
+}
+
+bool ParamCache::Bool(const std::string& key, bool def)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Link(key, TID_BOOL, def ? "1" : "0")->num != 0.0;
+}
+
+std::string ParamCache::Dir(const std::string& key, const std::string& def)
+{
+  std::string dir = String(key, def);
+
+  if (dir.size() > 0 && dir[dir.size() - 1] != DIR_SEPARATOR) {
+    dir += DIR_SEPARATOR_STR;
+  }
+
+  return dir;
+}
+
+bool ParamCache::OnChange(const std::string& key,
+                          std::function<void()> callback)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+
+  if (it == entries_.end() || it->second->hkey == 0) {
+    return false;
+  }
+
+  it->second->on_change = callback;
+  return true;
+}
+
+void ParamCache::Close()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (auto &it : entries_) {
+    if (it.second->hkey) {
+      db_close_record(hdb_, it.second->hkey);
+    }
+  }
+
+  entries_.clear();
+}
+
+ParamCache::entry *ParamCache::Link(const std::string& key, INT type,
+                                    const std::string& def)
+{
+  auto it = entries_.find(key);
+
+  if (it != entries_.end()) {
+    entry *e = it->second.get();
+
+    // The record no longer matches the key, open it at the new size.
+    if (e->stale) {
+      HNDLE hkey = e->hkey;
+
+      db_close_record(hdb_, hkey);
+      e->hkey = 0;
+      e->stale = false;
+      Open(key, e, hkey, e->str);
+    }
+
+    return e;
+  }
+
+  entry *e = new entry();
+  entries_[key].reset(e);
+
+  e->cache = this;
+  e->hkey = 0;
+  e->stale = false;
+  e->type = type;
+  e->str = def;
+  e->num = atof(def.c_str());
+
+  if (hdb_ == 0) {
+    cm_get_experiment_database(&hdb_, NULL);
+  }
+
+  HNDLE hkey = 0;
+  KEY odb_key;
+
+  if (db_find_key(hdb_, 0, key.c_str(), &hkey) != DB_SUCCESS) {
+
+    // Create it with the default, strings get room to be edited.
+    INT status;
+
+    if (type == TID_STRING) {
+      std::vector<char> str(std::max<size_t>(256, def.size() + 1), 0);
+      std::copy(def.begin(), def.end(), str.begin());
+      status = db_set_value(hdb_, 0, key.c_str(), str.data(), str.size(),
+                            1, TID_STRING);
+
+    } else if (type == TID_DOUBLE) {
+      double val = e->num;
+      status = db_set_value(hdb_, 0, key.c_str(), &val, sizeof(val),
+                            1, TID_DOUBLE);
+
+    } else {
+      INT val = e->num;
+      status = db_set_value(hdb_, 0, key.c_str(), &val, sizeof(val),
+                            1, type);
+    }
+
+    if (status != DB_SUCCESS ||
+        db_find_key(hdb_, 0, key.c_str(), &hkey) != DB_SUCCESS) {
+      cm_msg(MERROR, "param_cache", "cannot create \"%s\", using \"%s\"",
+             key.c_str(), def.c_str());
+      return e;
+    }
+
+    cm_msg(MINFO, "param_cache", "created missing \"%s\" = \"%s\"",
+           key.c_str(), def.c_str());
+  }
+
+  Open(key, e, hkey, def);
+  return e;
+}
+
+bool ParamCache::Open(const std::string& key, entry *e, HNDLE hkey,
+                      const std::string& def)
+{
+  KEY odb_key;
+
+  if (db_get_key(hdb_, hkey, &odb_key) != DB_SUCCESS) {
+    cm_msg(MERROR, "param_cache", "cannot read \"%s\", using \"%s\"",
+           key.c_str(), def.c_str());
+    return false;
+  }
+
+  if (odb_key.type == TID_KEY) {
+    cm_msg(MERROR, "param_cache", "\"%s\" is a directory, using \"%s\"",
+           key.c_str(), def.c_str());
+    return false;
+  }
+
+  // Opening the record copies the current value into staging.
+  e->type = odb_key.type;
+  e->staging.assign(odb_key.total_size, 0);
+
+  if (db_open_record(hdb_, hkey, e->staging.data(), e->staging.size(),
+                     MODE_READ, Update, e) != DB_SUCCESS) {
+    cm_msg(MERROR, "param_cache", "cannot hot-link \"%s\", using \"%s\"",
+           key.c_str(), def.c_str());
+    return false;
+  }
+
+  e->hkey = hkey;
+  Convert(e);
+
+  return true;
+}
+
+void ParamCache::Convert(entry *e)
+{
+  const char *data = e->staging.data();
+
+  switch (e->type) {
+    case TID_STRING:
+      e->str = std::string(data, strnlen(data, e->staging.size()));
+      e->num = atof(e->str.c_str());
+      return;
+    case TID_BYTE:
+    case TID_CHAR:
+      e->num = *(const BYTE *)data;
+      break;
+    case TID_SBYTE:
+      e->num = *(const char *)data;
+      break;
+    case TID_WORD:
+      e->num = *(const WORD *)data;
+      break;
+    case TID_SHORT:
+      e->num = *(const short *)data;
+      break;
+    case TID_DWORD:
+      e->num = *(const DWORD *)data;
+      break;
+    case TID_INT:
+      e->num = *(const INT *)data;
+      break;
+    case TID_BOOL:
+      e->num = (*(const BOOL *)data) ? 1 : 0;
+      break;
+    case TID_FLOAT:
+      e->num = *(const float *)data;
+      break;
+    case TID_DOUBLE:
+      e->num = *(const double *)data;
+      break;
+    default:
+      return;
+  }
+
+  char str[32];
+  snprintf(str, sizeof(str), "%.17g", e->num);
+  e->str = std::string(str);
+}
+
+void ParamCache::Update(HNDLE hDB, HNDLE hkey, void *info)
+{
+  entry *e = (entry *)info;
+  std::function<void()> on_change;
+  KEY odb_key;
+
+  {
+    std::lock_guard<std::mutex> lock(e->cache->mutex_);
+
+    // MIDAS leaves a record alone that doesn't match the key's size.
+    if (db_get_key(hDB, hkey, &odb_key) == DB_SUCCESS &&
+        odb_key.total_size != (INT)e->staging.size()) {
+      e->stale = true;
+
+    } else {
+      Convert(e);
+    }
+
+    on_change = e->on_change;
+  }
+
+  // Outside the lock, the callback is likely to read parameters.
+  if (on_change) {
+    on_change();
+  }
+}
+
+} // ::util
@@ -0,0 +1,153 @@
+#include "util/prearm.hh"
+#include "util/realtime.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <unistd.h>
+#include <stdio.h>
+#include <chrono>
+
+namespace util {
+
+root_output_config ReadRootOutputConfig(ParamCache& params,
+                                        const char *client)
+{
+  root_output_config conf;
+  std::string prefix = "/Params/root-compression/";
+
+  conf.algorithm = params.String(prefix + "algorithm", "LZ4");
+  conf.level = params.Int(prefix + "level", 4);
+  conf.basket_size = params.Int(prefix + "basket-size", 0);
+  conf.flush_bytes = params.Int(prefix + "flush-bytes", 32000000);
+  conf.autosave_bytes = params.Int(prefix + "autosave-bytes", 300000000);
+
+  if (!IsCompressionAlgorithm(conf.algorithm)) {
+    cm_msg(MERROR, client, "unknown ROOT compression algorithm "
+           "\"%s\" in /Params/root-compression, using ZLIB",
+           conf.algorithm.c_str());
+  }
+
+  return conf;
+}
+
+std::string OutputSignature(ParamCache& params)
+{
+  std::string prefix = "/Params/root-compression/";
+  std::string sig = params.Dir("/Logger/Data dir");
+
+  sig += "|" + std::to_string(params.Bool("/Params/root-output", true));
+  sig += "|" + params.String(prefix + "algorithm", "LZ4");
+  sig += "|" + std::to_string(params.Int(prefix + "level", 4));
+  sig += "|" + std::to_string(params.Int(prefix + "basket-size", 0));
+  sig += "|" + std::to_string(params.Int(prefix + "flush-bytes", 32000000));
+  sig += "|" + std::to_string(params.Int(prefix + "autosave-bytes",
+                                         300000000));
+  sig += "|" + params.String("/Params/root-layout", "split");
+
+  return sig;
+}
+
+armed_run OpenRunOutput(
+  ParamCache& params, const char *client, int run_number,
+  const std::string& name_format,
+  const std::vector<std::pair<std::string, std::string>>& trees)
+{
+  armed_run run;
+  run.run_number = run_number;
+  run.signature = OutputSignature(params);
+  run.file = nullptr;
+  run.arm_ms = 0.0;
+
+  if (!params.Bool("/Params/root-output", true)) {
+    return run;
+  }
+
+  char filename[256];
+  std::string path = params.Dir("/Logger/Data dir") + name_format;
+  snprintf(filename, sizeof(filename), path.c_str(), run_number);
+
+  run.conf = ReadRootOutputConfig(params, client);
+
+  // Split per-channel branches unless the old layout is requested.
+  run.layout = ParseTraceLayout(params.String("/Params/root-layout",
+                                              "split"));
+
+  run.file = new TFile(filename, "recreate", "",
+                       CompressionSettings(run.conf.algorithm,
+                                           run.conf.level));
+
+  for (auto &tree : trees) {
+    run.trees.push_back(new TTree(tree.first.c_str(), tree.second.c_str()));
+    SetFlushPolicy(run.trees.back(), run.conf);
+  }
+
+  return run;
+}
+
+void Disarm(armed_run &run)
+{
+  if (run.file != nullptr) {
+    std::string filename(run.file->GetName());
+
+    run.file->Close();
+    delete run.file;
+    unlink(filename.c_str());
+
+    run.file = nullptr;
+    run.trees.clear();
+  }
+}
+
+PreArmer::PreArmer(ParamCache& params) : params_(params)
+{
+}
+
+void PreArmer::Launch(arm_function arm, int run_number)
+{
+  next_run_ = std::async(std::launch::async, [arm, run_number] {
+      // Threads inherit the readout's cores and SCHED_FIFO priority.
+      SetNormalScheduling();
+
+      auto t0 = std::chrono::steady_clock::now();
+      armed_run run = arm(run_number);
+      auto t1 = std::chrono::steady_clock::now();
+
+      run.arm_ms = std::chrono::duration<double>(t1 - t0).count() * 1.0e3;
+      return run;
+    });
+}
+
+armed_run PreArmer::Take(arm_function arm, int run_number, bool &prearmed)
+{
+  armed_run run;
+  prearmed = false;
+
+  if (next_run_.valid()) {
+    run = next_run_.get();
+    prearmed = (run.error.empty() && run.run_number == run_number &&
+                run.signature == OutputSignature(params_));
+
+    if (!prearmed) {
+      Disarm(run);
+    }
+  }
+
+  if (!prearmed) {
+    auto t0 = std::chrono::steady_clock::now();
+    run = arm(run_number);
+    auto t1 = std::chrono::steady_clock::now();
+
+    run.arm_ms = std::chrono::duration<double>(t1 - t0).count() * 1.0e3;
+  }
+
+  return run;
+}
+
+void PreArmer::Cancel()
+{
+  if (next_run_.valid()) {
+    armed_run run = next_run_.get();
+    Disarm(run);
+  }
+}
+
+} // ::util
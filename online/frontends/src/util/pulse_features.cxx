@@ -0,0 +1,156 @@
+#include "util/pulse_features.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+struct trace_reduction {
+  unsigned long long sum;
+  unsigned short min;
+  unsigned short max;
+};
+
+// Sum, min and max of a trace in one pass.
+trace_reduction Reduce(const unsigned short *x, int len)
+{
+  trace_reduction r;
+  r.sum = 0;
+  r.min = 0xffff;
+  r.max = 0;
+
+  int i = 0;
+
+#ifdef __SSE2__
+  // SSE2 only has signed 16-bit min/max, so flip the sign bit first.
+  const __m128i bias = _mm_set1_epi16((short)0x8000);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i vmin = _mm_set1_epi16(0x7fff);
+  __m128i vmax = _mm_set1_epi16((short)0x8000);
+
+  while (i + 8 <= len) {
+
+    // The 32-bit lanes are folded into the sum before they can overflow.
+    __m128i acc = zero;
+    int stop = std::min(len - 8, i + 8 * 4095);
+
+    for (; i <= stop; i += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(x + i));
+      __m128i b = _mm_xor_si128(v, bias);
+
+      vmin = _mm_min_epi16(vmin, b);
+      vmax = _mm_max_epi16(vmax, b);
+      acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+      acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+    }
+
+    unsigned int lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    r.sum += (unsigned long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+
+  unsigned short mins[8], maxs[8];
+  _mm_storeu_si128((__m128i *)mins, _mm_xor_si128(vmin, bias));
+  _mm_storeu_si128((__m128i *)maxs, _mm_xor_si128(vmax, bias));
+
+  for (int k = 0; k < 8; ++k) {
+    r.min = std::min(r.min, mins[k]);
+    r.max = std::max(r.max, maxs[k]);
+  }
+#endif
+
+  for (; i < len; ++i) {
+    r.sum += x[i];
+    r.min = std::min(r.min, x[i]);
+    r.max = std::max(r.max, x[i]);
+  }
+
+  return r;
+}
+
+// Index of the first sample equal to val.
+int FindFirst(const unsigned short *x, int len, unsigned short val)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128i target = _mm_set1_epi16((short)val);
+
+  for (; i + 8 <= len; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(x + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(v, target));
+
+    if (mask != 0) {
+      return i + __builtin_ctz(mask) / 2;
+    }
+  }
+#endif
+
+  for (; i < len; ++i) {
+    if (x[i] == val) return i;
+  }
+
+  return 0;
+}
+
+} // ::anonymous
+
+namespace util {
+
+void ExtractFeatures(const unsigned short *trace, int len,
+                     int baseline_samples, pulse_features &feat)
+{
+  if (len <= 0) {
+    feat.baseline = feat.amplitude = feat.peak_time = feat.integral = 0.0;
+    return;
+  }
+
+  int nb = std::max(1, std::min(baseline_samples, len));
+  double baseline = Reduce(trace, nb).sum / (double)nb;
+  auto r = Reduce(trace, len);
+
+  double hi = r.max - baseline;
+  double lo = baseline - r.min;
+
+  feat.baseline = baseline;
+  feat.integral = r.sum - baseline * len;
+
+  if (hi >= lo) {
+    feat.amplitude = hi;
+    feat.peak_time = FindFirst(trace, len, r.max);
+
+  } else {
+    feat.amplitude = -lo;
+    feat.peak_time = FindFirst(trace, len, r.min);
+  }
+}
+
+void ExtractFeatures(const unsigned short *traces, int num_ch, int len,
+                     int baseline_samples, pulse_features *feats)
+{
+  for (int ch = 0; ch < num_ch; ++ch) {
+    ExtractFeatures(traces + ch * len, len, baseline_samples, feats[ch]);
+  }
+}
+
+bool IsAnomalous(const pulse_features *feats, int num_ch,
+                 const feature_config &conf)
+{
+  if (conf.anomaly_amplitude <= 0.0) {
+    return false;
+  }
+
+  for (int ch = 0; ch < num_ch; ++ch) {
+    if (std::fabs(feats[ch].amplitude) > conf.anomaly_amplitude) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+} // ::util
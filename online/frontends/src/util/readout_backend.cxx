@@ -0,0 +1,24 @@
+#include "util/readout_backend.hh"
+
+//--- other includes --------------------------------------------------------//
+#include "boost/property_tree/ptree.hpp"
+#include "boost/property_tree/json_parser.hpp"
+
+//--- project includes ------------------------------------------------------//
+#include "util/sim_event_manager.hh"
+
+namespace util {
+
+ReadoutBackend *MakeReadoutBackend(const std::string& conf_file)
+{
+  boost::property_tree::ptree conf;
+  boost::property_tree::read_json(conf_file, conf);
+
+  if (conf.get<bool>("simulation.enabled", false)) {
+    return new SimEventManager(conf_file);
+  }
+
+  return new HardwareBackend(conf_file);
+}
+
+} // ::util
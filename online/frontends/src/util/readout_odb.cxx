@@ -0,0 +1,100 @@
+#include "util/readout_odb.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+
+namespace util {
+
+zs_config ReadZeroSuppressConfig(ParamCache& params,
+                                 const std::string& prefix,
+                                 const char *client)
+{
+  zs_config conf;
+
+  conf.enabled = params.Bool(prefix + "enabled");
+  conf.threshold = 0.0;
+  conf.pre_samples = params.Int(prefix + "pre-samples", 16);
+  conf.post_samples = params.Int(prefix + "post-samples", 64);
+  conf.baseline_samples = params.Int(prefix + "baseline-samples", 64);
+
+  if (conf.pre_samples < 0 || conf.post_samples < 0) {
+    cm_msg(MERROR, client, "negative pre-samples %i or post-samples %i in "
+           "%s, using 0", conf.pre_samples, conf.post_samples,
+           prefix.c_str());
+
+    conf.pre_samples = std::max(conf.pre_samples, 0);
+    conf.post_samples = std::max(conf.post_samples, 0);
+  }
+
+  return conf;
+}
+
+poll_policy ReadPollPolicy(ParamCache& params, const std::string& prefix,
+                           double window_ms)
+{
+  poll_policy policy;
+  std::string key = prefix + "poll/";
+
+  policy.adaptive = params.Bool(key + "adaptive", true);
+  policy.spin_us = params.Double(key + "spin-us", policy.spin_us);
+  policy.min_sleep_us = params.Double(key + "min-sleep-us",
+                                      policy.min_sleep_us);
+  policy.max_sleep_us = params.Double(key + "max-sleep-us",
+                                      policy.max_sleep_us);
+  policy.park_after_ms = params.Double(key + "park-after-ms",
+                                       policy.park_after_ms);
+  policy.park_us = params.Double(key + "park-us", policy.park_us);
+  policy.window_ms = window_ms;
+
+  return policy;
+}
+
+void PublishMetric(const std::string& equipment, const std::string& name,
+                   double val)
+{
+  HNDLE hDB;
+  std::string key = "/Equipment/" + equipment + "/Metrics/" + name;
+
+  cm_get_experiment_database(&hDB, NULL);
+  db_set_value(hDB, 0, key.c_str(), &val, sizeof(val), 1, TID_DOUBLE);
+}
+
+void PublishStartMetrics(const std::string& equipment, double start_ms,
+                         double arm_ms, bool prearmed)
+{
+  PublishMetric(equipment, "start-transition-ms", start_ms);
+  PublishMetric(equipment, "arm-ms", arm_ms);
+  PublishMetric(equipment, "prearmed", prearmed ? 1.0 : 0.0);
+}
+
+void PublishReadoutMetrics(const char *client, const std::string& equipment,
+                           const JitterMonitor& jitter,
+                           const AdaptivePoller& poller,
+                           unsigned long long dropped_events)
+{
+  // The latency between poll and readout.
+  cm_msg(MINFO, client, "%s", jitter.Report().c_str());
+
+  if (dropped_events > 0) {
+    cm_msg(MINFO, client, "simulation dropped %llu triggers",
+           dropped_events);
+  }
+
+  PublishMetric(equipment, "dropped-events", dropped_events);
+  PublishMetric(equipment, "jitter-p50-us", jitter.Percentile(0.5));
+  PublishMetric(equipment, "jitter-p99-us", jitter.Percentile(0.99));
+  PublishMetric(equipment, "jitter-max-us", jitter.max_us());
+
+  // And how quickly polling saw the events, and at what cost.
+  cm_msg(MINFO, client, "%s", poller.Report().c_str());
+
+  PublishMetric(equipment, "poll-detect-p50-us",
+                poller.detect().Percentile(0.5));
+  PublishMetric(equipment, "poll-detect-p99-us",
+                poller.detect().Percentile(0.99));
+  PublishMetric(equipment, "poll-busy-fraction", poller.busy_fraction());
+  PublishMetric(equipment, "poll-parks", poller.parks());
+  PublishMetric(equipment, "poll-mean-gap-us", poller.mean_interval_us());
+}
+
+} // ::util
@@ -0,0 +1,154 @@
+#include "util/realtime.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sstream>
+#include <algorithm>
+
+namespace util {
+
+std::vector<int> ParseCpuList(const std::string& cpu_list)
+{
+  std::vector<int> cpus;
+  std::stringstream ss(cpu_list);
+  std::string item;
+
+  while (std::getline(ss, item, ',')) {
+    int lo, hi;
+
+    if (sscanf(item.c_str(), "%d-%d", &lo, &hi) == 2) {
+      for (int i = lo; i <= hi; ++i) {
+        cpus.push_back(i);
+      }
+
+    } else if (sscanf(item.c_str(), "%d", &lo) == 1) {
+      cpus.push_back(lo);
+    }
+  }
+
+  return cpus;
+}
+
+int SetThreadAffinity(const std::vector<int>& cpus)
+{
+  if (cpus.size() == 0) {
+    return 0;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+
+  for (auto &cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+int SetRealtimePriority(int priority)
+{
+  if (priority <= 0) {
+    return 0;
+  }
+
+  sched_param param;
+  int lo = sched_get_priority_min(SCHED_FIFO);
+  int hi = sched_get_priority_max(SCHED_FIFO);
+  param.sched_priority = std::max(lo, std::min(hi, priority));
+
+  return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+int SetNormalScheduling()
+{
+  sched_param param;
+  param.sched_priority = 0;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    CPU_SET(cpu, &set);
+  }
+
+  int rc = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+  int rc_cpu = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+  return (rc != 0) ? rc : rc_cpu;
+}
+
+JitterMonitor::JitterMonitor(double bin_width_us, int num_bins) :
+  bin_width_us_(bin_width_us), bins_(num_bins, 0)
+{
+  Reset();
+}
+
+void JitterMonitor::Reset()
+{
+  std::fill(bins_.begin(), bins_.end(), 0);
+  overflow_ = 0;
+  count_ = 0;
+  sum_us_ = 0.0;
+  max_us_ = 0.0;
+  poll_pending_ = false;
+}
+
+void JitterMonitor::MarkReadout()
+{
+  if (!poll_pending_) return;
+
+  using namespace std::chrono;
+  auto dt = steady_clock::now() - last_poll_;
+  Fill(duration_cast<duration<double, std::micro>>(dt).count());
+  poll_pending_ = false;
+}
+
+void JitterMonitor::Fill(double dt_us)
+{
+  unsigned int idx = (unsigned int)(dt_us / bin_width_us_);
+
+  if (idx < bins_.size()) {
+    bins_[idx]++;
+  } else {
+    overflow_++;
+  }
+
+  count_++;
+  sum_us_ += dt_us;
+  max_us_ = std::max(max_us_, dt_us);
+}
+
+double JitterMonitor::Percentile(double q) const
+{
+  if (count_ == 0) return 0.0;
+
+  unsigned long long target = (unsigned long long)(q * count_);
+  unsigned long long sum = 0;
+
+  for (unsigned int i = 0; i < bins_.size(); ++i) {
+    sum += bins_[i];
+    if (sum > target) {
+      return (i + 1) * bin_width_us_;
+    }
+  }
+
+  // The quantile sits in the overflow, the max is the best we have.
+  return max_us_;
+}
+
+std::string JitterMonitor::Report() const
+{
+  char str[256];
+  sprintf(str, "poll-to-readout over %llu events: mean %.1f us, "
+          "p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us",
+          count_, mean_us(), Percentile(0.5), Percentile(0.99),
+          Percentile(0.999), max_us_);
+
+  return std::string(str);
+}
+
+} // ::util
@@ -0,0 +1,476 @@
+#include "util/run_log.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+//--- other includes --------------------------------------------------------//
+#include "boost/property_tree/ptree.hpp"
+#include "boost/property_tree/json_parser.hpp"
+
+namespace {
+
+const char *kSchema =
+  "CREATE TABLE IF NOT EXISTS runs ("
+  "  run INTEGER PRIMARY KEY,"
+  "  start_time TEXT,"
+  "  stop_time TEXT,"
+  "  events INTEGER,"
+  "  comment TEXT,"
+  "  config TEXT,"
+  "  start_unix INTEGER DEFAULT 0,"
+  "  stop_unix INTEGER DEFAULT 0);"
+  "CREATE TABLE IF NOT EXISTS tags ("
+  "  tag TEXT NOT NULL,"
+  "  run INTEGER NOT NULL,"
+  "  PRIMARY KEY (tag, run));"
+  "CREATE INDEX IF NOT EXISTS tags_by_run ON tags (run);"
+  "CREATE TABLE IF NOT EXISTS files ("
+  "  run INTEGER NOT NULL,"
+  "  path TEXT NOT NULL,"
+  "  PRIMARY KEY (run, path));";
+
+// Columns added since the first version of the schema.
+const char *kMigrations[] = {
+  "ALTER TABLE runs ADD COLUMN start_unix INTEGER DEFAULT 0;",
+  "ALTER TABLE runs ADD COLUMN stop_unix INTEGER DEFAULT 0;",
+  "CREATE INDEX IF NOT EXISTS runs_by_start ON runs (start_unix);",
+};
+
+const char *kSelectRuns =
+  "SELECT run, start_time, stop_time, events, comment, config, "
+  "start_unix, stop_unix FROM runs ";
+
+std::string JsonString(const std::string& str)
+{
+  std::string out("\"");
+
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+
+    } else if (c < 0x20) {
+      char esc[8];
+      sprintf(esc, "\\u%04x", c);
+      out += esc;
+
+    } else {
+      out += c;
+    }
+  }
+
+  return out + "\"";
+}
+
+std::string JsonList(const std::vector<std::string>& list)
+{
+  std::string out("[");
+
+  for (size_t i = 0; i < list.size(); ++i) {
+    out += (i > 0) ? ", " : "";
+    out += JsonString(list[i]);
+  }
+
+  return out + "]";
+}
+
+std::string ColumnText(sqlite3_stmt *stmt, int col)
+{
+  const unsigned char *text = sqlite3_column_text(stmt, col);
+  return (text == nullptr) ? std::string() : std::string((const char *)text);
+}
+
+} // ::anonymous
+
+namespace util {
+
+std::vector<std::string> SplitTags(const std::string& tags)
+{
+  std::vector<std::string> list;
+  std::istringstream ss(tags);
+  std::string tag;
+
+  while (std::getline(ss, tag, ',')) {
+    size_t first = tag.find_first_not_of(" \t");
+    size_t last = tag.find_last_not_of(" \t");
+
+    if (first != std::string::npos) {
+      list.push_back(tag.substr(first, last - first + 1));
+    }
+  }
+
+  return list;
+}
+
+long long ParseDate(const std::string& date)
+{
+  const char *formats[] = {"%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d"};
+
+  if (date.empty()) return 0;
+
+  for (auto format : formats) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(date.c_str(), format, &tm);
+
+    if (end != nullptr && *end == '\0') {
+      tm.tm_isdst = -1;
+      return mktime(&tm);
+    }
+  }
+
+  return -1;
+}
+
+std::string ToJson(const std::vector<run_entry>& entries)
+{
+  std::ostringstream ss;
+  ss << "[";
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    auto &entry = entries[i];
+
+    ss << ((i > 0) ? ",\n " : "")
+       << "{\"run\": " << entry.run
+       << ", \"start_time\": " << JsonString(entry.start_time)
+       << ", \"stop_time\": " << JsonString(entry.stop_time)
+       << ", \"start_unix\": " << entry.start_unix
+       << ", \"stop_unix\": " << entry.stop_unix
+       << ", \"events\": " << entry.events
+       << ", \"comment\": " << JsonString(entry.comment)
+       << ", \"tags\": " << JsonList(entry.tags)
+       << ", \"files\": " << JsonList(entry.files)
+       << ", \"config\": " << JsonString(entry.config) << "}";
+  }
+
+  ss << "]";
+  return ss.str();
+}
+
+RunLog::RunLog() : db_(nullptr)
+{
+}
+
+RunLog::~RunLog()
+{
+  Close();
+}
+
+bool RunLog::Open(const std::string& db_file)
+{
+  Close();
+
+  if (!Check(sqlite3_open(db_file.c_str(), &db_))) {
+    Close();
+    return false;
+  }
+
+  // Other processes read the log while the analyzer writes to it.
+  sqlite3_busy_timeout(db_, 2000);
+
+  if (!Exec("PRAGMA journal_mode=WAL;") || !Exec(kSchema)) {
+    return false;
+  }
+
+  // Existing columns make these fail, which is fine.
+  for (auto sql : kMigrations) {
+    sqlite3_exec(db_, sql, nullptr, nullptr, nullptr);
+  }
+
+  return true;
+}
+
+void RunLog::Close()
+{
+  if (db_ != nullptr) {
+    sqlite3_close(db_);
+    db_ = nullptr;
+  }
+}
+
+bool RunLog::Append(const run_entry& entry)
+{
+  sqlite3_stmt *stmt;
+
+  if (db_ == nullptr) {
+    error_ = "run log is not open";
+    return false;
+  }
+
+  if (!Exec("BEGIN;")) return false;
+
+  bool ok = Check(sqlite3_prepare_v2(db_,
+    "INSERT OR REPLACE INTO runs VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
+    -1, &stmt, nullptr));
+
+  if (ok) {
+    sqlite3_bind_int(stmt, 1, entry.run);
+    sqlite3_bind_text(stmt, 2, entry.start_time.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 3, entry.stop_time.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 4, entry.events);
+    sqlite3_bind_text(stmt, 5, entry.comment.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 6, entry.config.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 7, entry.start_unix);
+    sqlite3_bind_int64(stmt, 8, entry.stop_unix);
+    ok = Check(sqlite3_step(stmt));
+    sqlite3_finalize(stmt);
+  }
+
+  // Replace the tag and file lists of the run.
+  const char *clear[] = {"DELETE FROM tags WHERE run = ?;",
+                         "DELETE FROM files WHERE run = ?;"};
+
+  for (auto sql : clear) {
+    if (ok) {
+      ok = Check(sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr));
+    }
+
+    if (ok) {
+      sqlite3_bind_int(stmt, 1, entry.run);
+      ok = Check(sqlite3_step(stmt));
+      sqlite3_finalize(stmt);
+    }
+  }
+
+  if (ok) {
+    ok = Check(sqlite3_prepare_v2(db_,
+      "INSERT OR IGNORE INTO tags VALUES (?, ?);", -1, &stmt, nullptr));
+  }
+
+  if (ok) {
+    for (auto &tag : entry.tags) {
+      sqlite3_bind_text(stmt, 1, tag.c_str(), -1, SQLITE_TRANSIENT);
+      sqlite3_bind_int(stmt, 2, entry.run);
+      ok = ok && Check(sqlite3_step(stmt));
+      sqlite3_reset(stmt);
+    }
+
+    sqlite3_finalize(stmt);
+  }
+
+  if (ok) {
+    ok = Check(sqlite3_prepare_v2(db_,
+      "INSERT OR IGNORE INTO files VALUES (?, ?);", -1, &stmt, nullptr));
+  }
+
+  if (ok) {
+    for (auto &path : entry.files) {
+      sqlite3_bind_int(stmt, 1, entry.run);
+      sqlite3_bind_text(stmt, 2, path.c_str(), -1, SQLITE_TRANSIENT);
+      ok = ok && Check(sqlite3_step(stmt));
+      sqlite3_reset(stmt);
+    }
+
+    sqlite3_finalize(stmt);
+  }
+
+  if (!ok) {
+    Exec("ROLLBACK;");
+    return false;
+  }
+
+  return Exec("COMMIT;");
+}
+
+bool RunLog::Find(int run, run_entry& entry)
+{
+  sqlite3_stmt *stmt;
+
+  if (db_ == nullptr) return false;
+
+  std::string sql = std::string(kSelectRuns) + "WHERE run = ?;";
+
+  if (!Check(sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr))) {
+    return false;
+  }
+
+  sqlite3_bind_int(stmt, 1, run);
+  bool found = (sqlite3_step(stmt) == SQLITE_ROW);
+
+  if (found) {
+    ReadRow(stmt, entry);
+  }
+
+  sqlite3_finalize(stmt);
+
+  if (found) {
+    ReadLists(entry);
+  }
+
+  return found;
+}
+
+std::vector<int> RunLog::FindByTag(const std::string& tag)
+{
+  std::vector<int> runs;
+  sqlite3_stmt *stmt;
+
+  if (db_ == nullptr) return runs;
+
+  if (Check(sqlite3_prepare_v2(db_,
+        "SELECT run FROM tags WHERE tag = ? ORDER BY run;",
+        -1, &stmt, nullptr))) {
+    sqlite3_bind_text(stmt, 1, tag.c_str(), -1, SQLITE_TRANSIENT);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      runs.push_back(sqlite3_column_int(stmt, 0));
+    }
+
+    sqlite3_finalize(stmt);
+  }
+
+  return runs;
+}
+
+std::vector<run_entry> RunLog::Query(const run_query& query)
+{
+  std::vector<run_entry> entries;
+  sqlite3_stmt *stmt;
+
+  if (db_ == nullptr) return entries;
+
+  // Unused conditions are switched off by their parameter.
+  std::string sql = std::string(kSelectRuns) +
+    "WHERE (?1 = '' OR run IN (SELECT run FROM tags WHERE tag = ?1)) "
+    "AND (?2 = 0 OR start_unix >= ?2) "
+    "AND (?3 = 0 OR start_unix < ?3) "
+    "ORDER BY run DESC LIMIT ?4;";
+
+  if (!Check(sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr))) {
+    return entries;
+  }
+
+  sqlite3_bind_text(stmt, 1, query.tag.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int64(stmt, 2, query.from);
+  sqlite3_bind_int64(stmt, 3, query.to);
+  sqlite3_bind_int(stmt, 4, (query.limit > 0) ? query.limit : -1);
+
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    entries.push_back(run_entry());
+    ReadRow(stmt, entries.back());
+  }
+
+  sqlite3_finalize(stmt);
+
+  for (auto &entry : entries) {
+    ReadLists(entry);
+  }
+
+  return entries;
+}
+
+int RunLog::ImportJson(const std::string& runlog_json)
+{
+  using namespace boost::property_tree;
+
+  ptree pt_runlog;
+  int count = 0;
+
+  try {
+    read_json(runlog_json, pt_runlog);
+
+  } catch (...) {
+    return 0;
+  }
+
+  for (auto &kv : pt_runlog) {
+
+    // Keys look like run_00042.
+    if (kv.first.compare(0, 4, "run_") != 0) continue;
+
+    run_entry entry;
+    entry.run = atoi(kv.first.c_str() + 4);
+    entry.events = 0;
+    entry.start_unix = 0;
+    entry.stop_unix = 0;
+
+    // Don't clobber runs that are already in the database.
+    run_entry existing;
+    if (Find(entry.run, existing)) continue;
+
+    entry.comment = kv.second.get<std::string>("comment", "");
+
+    auto tags = kv.second.get_child_optional("tags");
+    if (tags) {
+      for (auto &tag : *tags) {
+        entry.tags.push_back(tag.second.data());
+      }
+    }
+
+    if (Append(entry)) count++;
+  }
+
+  return count;
+}
+
+bool RunLog::Exec(const char *sql)
+{
+  char *msg = nullptr;
+  int status = sqlite3_exec(db_, sql, nullptr, nullptr, &msg);
+
+  if (status != SQLITE_OK) {
+    error_ = (msg != nullptr) ? msg : sqlite3_errstr(status);
+    sqlite3_free(msg);
+    return false;
+  }
+
+  return true;
+}
+
+bool RunLog::Check(int status)
+{
+  if (status == SQLITE_OK || status == SQLITE_DONE || status == SQLITE_ROW) {
+    return true;
+  }
+
+  error_ = (db_ != nullptr) ? sqlite3_errmsg(db_) : sqlite3_errstr(status);
+  return false;
+}
+
+void RunLog::ReadRow(sqlite3_stmt *stmt, run_entry& entry)
+{
+  entry.run = sqlite3_column_int(stmt, 0);
+  entry.start_time = ColumnText(stmt, 1);
+  entry.stop_time = ColumnText(stmt, 2);
+  entry.events = sqlite3_column_int64(stmt, 3);
+  entry.comment = ColumnText(stmt, 4);
+  entry.config = ColumnText(stmt, 5);
+  entry.start_unix = sqlite3_column_int64(stmt, 6);
+  entry.stop_unix = sqlite3_column_int64(stmt, 7);
+}
+
+void RunLog::ReadLists(run_entry& entry)
+{
+  sqlite3_stmt *stmt;
+
+  entry.tags.clear();
+  entry.files.clear();
+
+  if (Check(sqlite3_prepare_v2(db_, "SELECT tag FROM tags WHERE run = ?;",
+                               -1, &stmt, nullptr))) {
+    sqlite3_bind_int(stmt, 1, entry.run);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      entry.tags.push_back(ColumnText(stmt, 0));
+    }
+
+    sqlite3_finalize(stmt);
+  }
+
+  if (Check(sqlite3_prepare_v2(db_, "SELECT path FROM files WHERE run = ?;",
+                               -1, &stmt, nullptr))) {
+    sqlite3_bind_int(stmt, 1, entry.run);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      entry.files.push_back(ColumnText(stmt, 0));
+    }
+
+    sqlite3_finalize(stmt);
+  }
+}
+
+} // ::util
@@ -0,0 +1,240 @@
+#include "util/sim_event_manager.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <chrono>
+#include <algorithm>
+
+//--- other includes --------------------------------------------------------//
+#include "boost/property_tree/ptree.hpp"
+#include "boost/property_tree/json_parser.hpp"
+
+namespace util {
+
+SimEventManager::SimEventManager(const std::string& conf_file)
+{
+  boost::property_tree::ptree conf;
+  boost::property_tree::read_json(conf_file, conf);
+
+  // One simulated board per configured device.
+  num_sis3316_ = 0;
+  num_sis3302_ = 0;
+
+  auto devices = conf.get_child_optional("devices");
+
+  if (devices) {
+    auto sis3316 = devices->get_child_optional("sis_3316");
+    auto sis3302 = devices->get_child_optional("sis_3302");
+
+    if (sis3316) num_sis3316_ = sis3316->size();
+    if (sis3302) num_sis3302_ = sis3302->size();
+  }
+
+  fid_ = DefaultFidConfig();
+  rate_ = conf.get<double>("simulation.rate", 10.0);
+  poisson_ = conf.get<bool>("simulation.poisson", true);
+  canned_events_ = conf.get<int>("simulation.canned_events", 0);
+  queue_depth_ = conf.get<int>("simulation.queue_depth", 64);
+  seed_ = conf.get<int>("simulation.seed", 42);
+  trace_length_ = conf.get<int>("simulation.trace_length", 0);
+  fid_.sample_rate = conf.get<double>("simulation.sample_rate",
+                                      fid_.sample_rate);
+  fid_.frequency = conf.get<double>("simulation.frequency", fid_.frequency);
+  fid_.t2 = conf.get<double>("simulation.t2", fid_.t2);
+  fid_.amplitude = conf.get<double>("simulation.amplitude", fid_.amplitude);
+  fid_.baseline = conf.get<double>("simulation.baseline", fid_.baseline);
+  fid_.noise = conf.get<double>("simulation.noise", fid_.noise);
+
+  thread_live_ = false;
+  paused_ = false;
+  dropped_events_ = 0;
+}
+
+SimEventManager::~SimEventManager()
+{
+  EndOfRun();
+}
+
+int SimEventManager::BeginOfRun()
+{
+  EndOfRun();
+
+  // Pre-generate events if asked, handy to benchmark the rest of the chain.
+  FidGenerator gen(seed_);
+  canned_.resize(canned_events_);
+
+  for (auto &data : canned_) {
+    ResizeEventData(data);
+    GenerateEvent(gen, data);
+  }
+
+  dropped_events_ = 0;
+  paused_ = false;
+  thread_live_ = true;
+  trigger_thread_ = std::thread(&SimEventManager::TriggerLoop, this);
+
+  return 0;
+}
+
+int SimEventManager::EndOfRun()
+{
+  thread_live_ = false;
+
+  if (trigger_thread_.joinable()) {
+    trigger_thread_.join();
+  }
+
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+  queue_.clear();
+
+  return 0;
+}
+
+int SimEventManager::PauseRun()
+{
+  paused_ = true;
+  return 0;
+}
+
+int SimEventManager::ResumeRun()
+{
+  paused_ = false;
+  return 0;
+}
+
+int SimEventManager::ResizeEventData(daq::event_data &data)
+{
+  data.sis_3316_vec.resize(num_sis3316_);
+  data.sis_3302_vec.resize(num_sis3302_);
+  return 0;
+}
+
+bool SimEventManager::HasEvent()
+{
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+  return !queue_.empty();
+}
+
+// The front stays put while the trigger thread appends to the deque.
+const daq::event_data &SimEventManager::GetCurrentEvent()
+{
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+  return queue_.front();
+}
+
+void SimEventManager::PopCurrentEvent()
+{
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+
+  if (!queue_.empty()) {
+    queue_.pop_front();
+  }
+}
+
+bool SimEventManager::HasRoom()
+{
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+  return queue_.size() < queue_depth_;
+}
+
+void SimEventManager::GenerateEvent(FidGenerator &gen, daq::event_data &data)
+{
+  int len = (trace_length_ > 0) ? trace_length_ : SIS_3316_LN;
+  len = std::min(len, (int)SIS_3316_LN);
+
+  for (auto &sis : data.sis_3316_vec) {
+    for (int ch = 0; ch < SIS_3316_CH; ++ch) {
+      gen.Fill(&sis.trace[ch][0], len, fid_);
+      std::fill(&sis.trace[ch][0] + len, &sis.trace[ch][0] + SIS_3316_LN,
+                (unsigned short)fid_.baseline);
+    }
+  }
+
+  len = (trace_length_ > 0) ? trace_length_ : SIS_3302_LN;
+  len = std::min(len, (int)SIS_3302_LN);
+
+  for (auto &sis : data.sis_3302_vec) {
+    for (int ch = 0; ch < SIS_3302_CH; ++ch) {
+      gen.Fill(&sis.trace[ch][0], len, fid_);
+      std::fill(&sis.trace[ch][0] + len, &sis.trace[ch][0] + SIS_3302_LN,
+                (unsigned short)fid_.baseline);
+    }
+  }
+}
+
+void SimEventManager::TriggerLoop()
+{
+  using namespace std::chrono;
+
+  FidGenerator gen(seed_ + 1);
+  std::mt19937 rng(seed_);
+  std::exponential_distribution<double> wait(rate_ > 0.0 ? rate_ : 1.0);
+
+  daq::event_data data;
+  ResizeEventData(data);
+
+  auto t0 = steady_clock::now();
+  auto next_trigger = t0;
+  unsigned long long count = 0;
+
+  while (thread_live_) {
+
+    if (paused_) {
+      std::this_thread::sleep_for(milliseconds(10));
+      next_trigger = steady_clock::now();
+      continue;
+    }
+
+    if (rate_ > 0.0) {
+      double dt = poisson_ ? wait(rng) : 1.0 / rate_;
+      next_trigger += duration_cast<steady_clock::duration>(
+        duration<double>(dt));
+      std::this_thread::sleep_until(next_trigger);
+
+    } else {
+
+      // As fast as possible means as fast as the readout keeps up.
+      while (thread_live_ && !HasRoom()) {
+        std::this_thread::sleep_for(microseconds(100));
+      }
+    }
+
+    if (!thread_live_) break;
+
+    if (canned_.size() > 0) {
+      data = canned_[count % canned_.size()];
+    } else {
+      GenerateEvent(gen, data);
+    }
+
+    // Stamp the clocks, the device clock counts samples since start.
+    unsigned long long now_us = daq::systime_us();
+    double t = duration<double>(steady_clock::now() - t0).count();
+    unsigned long long ticks = t * fid_.sample_rate;
+
+    for (auto &sis : data.sis_3316_vec) {
+      sis.system_clock = now_us;
+      for (int ch = 0; ch < SIS_3316_CH; ++ch) {
+        sis.device_clock[ch] = ticks;
+      }
+    }
+
+    for (auto &sis : data.sis_3302_vec) {
+      sis.system_clock = now_us;
+      for (int ch = 0; ch < SIS_3302_CH; ++ch) {
+        sis.device_clock[ch] = ticks;
+      }
+    }
+
+    count++;
+
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+
+    if (queue_.size() < queue_depth_) {
+      queue_.push_back(data);
+    } else {
+      dropped_events_++;
+    }
+  }
+}
+
+} // ::util
@@ -0,0 +1,240 @@
+#include "util/spectrum.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <cmath>
+#include <algorithm>
+
+namespace util {
+
+SpectrumAccumulator::SpectrumAccumulator(int num_ch, int trace_len,
+                                         double dt) :
+  num_ch_(num_ch), trace_len_(trace_len), num_bins_(trace_len / 2 + 1)
+{
+  in_ = (double *)fftw_malloc(sizeof(double) * trace_len_);
+  out_ = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * num_bins_);
+  plan_ = fftw_plan_dft_r2c_1d(trace_len_, in_, out_, FFTW_ESTIMATE);
+
+  for (int k = 0; k < num_bins_; ++k) {
+    freq_.push_back(k / (trace_len_ * dt));
+  }
+
+  // A Hann taper keeps strong lines from leaking over weak ones, the
+  // power is normalized by its sum of squares.
+  double norm = 0.0;
+
+  for (int i = 0; i < trace_len_; ++i) {
+    double w = 0.5 - 0.5 * cos(2 * M_PI * i / trace_len_);
+    taper_.push_back(w);
+    norm += w * w;
+  }
+
+  for (auto &w : taper_) {
+    w /= sqrt(norm);
+  }
+
+  power_.resize(num_ch_ * num_bins_);
+
+  Reset(spectrum_config());
+}
+
+SpectrumAccumulator::~SpectrumAccumulator()
+{
+  fftw_destroy_plan(plan_);
+  fftw_free(in_);
+  fftw_free(out_);
+}
+
+void SpectrumAccumulator::Reset(const spectrum_config& conf)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  conf_ = conf;
+  conf_.alpha = std::min(std::max(conf_.alpha, 0.0), 1.0);
+  conf_.window = std::max(conf_.window, 1);
+  conf_.rows = std::max(conf_.rows, 1);
+  conf_.row_events = std::max(conf_.row_events, 1);
+  conf_.bins = std::min(std::max(conf_.bins, 1), num_bins_);
+
+  num_events_ = 0;
+
+  // assign rather than resize, so a smaller config also frees memory
+  exp_avg_.assign(num_ch_ * num_bins_, 0.0);
+  window_sum_.assign(num_ch_ * num_bins_, 0.0);
+  window_.assign((size_t)num_ch_ * conf_.window * num_bins_, 0.0);
+  window_.shrink_to_fit();
+  window_next_ = 0;
+
+  rows_.assign((size_t)num_ch_ * conf_.rows * conf_.bins, 0.0);
+  rows_.shrink_to_fit();
+  row_sum_.assign(num_ch_ * conf_.bins, 0.0);
+  row_count_ = 0;
+  row_next_ = 0;
+  rows_done_ = 0;
+}
+
+void SpectrumAccumulator::Fill(const uint16_t *traces)
+{
+  // The transforms run without the lock, readers only wait for the sums.
+  for (int ch = 0; ch < num_ch_; ++ch) {
+    const uint16_t *trace = traces + (size_t)ch * trace_len_;
+    double *power = &power_[ch * num_bins_];
+    double mean = 0.0;
+
+    for (int i = 0; i < trace_len_; ++i) {
+      mean += trace[i];
+    }
+
+    mean /= trace_len_;
+
+    for (int i = 0; i < trace_len_; ++i) {
+      in_[i] = (trace[i] - mean) * taper_[i];
+    }
+
+    fftw_execute(plan_);
+
+    for (int k = 0; k < num_bins_; ++k) {
+      power[k] = out_[k][0] * out_[k][0] + out_[k][1] * out_[k][1];
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  bool wrapped = (window_next_ == conf_.window - 1);
+
+  for (int ch = 0; ch < num_ch_; ++ch) {
+    const double *power = &power_[ch * num_bins_];
+    double *exp_avg = &exp_avg_[ch * num_bins_];
+    double *sum = &window_sum_[ch * num_bins_];
+    float *slot = &window_[((size_t)ch * conf_.window + window_next_) *
+                           num_bins_];
+
+    for (int k = 0; k < num_bins_; ++k) {
+      if (num_events_ == 0) {
+        exp_avg[k] = power[k];
+      } else {
+        exp_avg[k] += conf_.alpha * (power[k] - exp_avg[k]);
+      }
+
+      // Swap the oldest event out of the window for this one.
+      sum[k] -= slot[k];
+      slot[k] = power[k];
+      sum[k] += slot[k];
+    }
+
+    // Re-sum once per pass through the ring so rounding can't build up.
+    if (wrapped) {
+      const float *ring = &window_[(size_t)ch * conf_.window * num_bins_];
+
+      std::fill(sum, sum + num_bins_, 0.0);
+
+      for (int i = 0; i < conf_.window; ++i, ring += num_bins_) {
+        for (int k = 0; k < num_bins_; ++k) {
+          sum[k] += ring[k];
+        }
+      }
+    }
+
+    // Merge frequency bins into the spectrogram columns.
+    double *row = &row_sum_[ch * conf_.bins];
+
+    for (int c = 0; c < conf_.bins; ++c) {
+      int lo = (long long)c * num_bins_ / conf_.bins;
+      int hi = (long long)(c + 1) * num_bins_ / conf_.bins;
+      double val = 0.0;
+
+      for (int k = lo; k < hi; ++k) {
+        val += power[k];
+      }
+
+      row[c] += val / (hi - lo);
+    }
+  }
+
+  window_next_ = (window_next_ + 1) % conf_.window;
+  ++num_events_;
+
+  // Close the spectrogram row once it has its events.
+  if (++row_count_ == conf_.row_events) {
+
+    for (int ch = 0; ch < num_ch_; ++ch) {
+      double *row = &row_sum_[ch * conf_.bins];
+      float *dst = &rows_[((size_t)ch * conf_.rows + row_next_) * conf_.bins];
+
+      for (int c = 0; c < conf_.bins; ++c) {
+        dst[c] = row[c] / row_count_;
+        row[c] = 0.0;
+      }
+    }
+
+    row_count_ = 0;
+    row_next_ = (row_next_ + 1) % conf_.rows;
+    rows_done_ = std::min(rows_done_ + 1, conf_.rows);
+  }
+}
+
+void SpectrumAccumulator::ExpAverage(int ch, std::vector<double>& power)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  power.clear();
+
+  if (num_events_ == 0 || ch < 0 || ch >= num_ch_) return;
+
+  auto it = exp_avg_.begin() + ch * num_bins_;
+  power.assign(it, it + num_bins_);
+}
+
+void SpectrumAccumulator::WindowAverage(int ch, std::vector<double>& power)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  power.clear();
+
+  if (num_events_ == 0 || ch < 0 || ch >= num_ch_) return;
+
+  double n = std::min(num_events_, (long long)conf_.window);
+  auto it = window_sum_.begin() + ch * num_bins_;
+
+  for (int k = 0; k < num_bins_; ++k) {
+    power.push_back(it[k] / n);
+  }
+}
+
+int SpectrumAccumulator::Spectrogram(int ch, std::vector<float>& rows,
+                                     int& num_cols)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  rows.clear();
+  num_cols = conf_.bins;
+
+  if (ch < 0 || ch >= num_ch_) return 0;
+
+  // The oldest row is the next to be overwritten once the ring is full.
+  int first = (rows_done_ < conf_.rows) ? 0 : row_next_;
+  auto ring = rows_.begin() + (size_t)ch * conf_.rows * conf_.bins;
+
+  for (int i = 0; i < rows_done_; ++i) {
+    auto it = ring + (size_t)((first + i) % conf_.rows) * conf_.bins;
+    rows.insert(rows.end(), it, it + conf_.bins);
+  }
+
+  return rows_done_;
+}
+
+long long SpectrumAccumulator::num_events()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_events_;
+}
+
+size_t SpectrumAccumulator::bytes()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return sizeof(double) * (exp_avg_.size() + window_sum_.size() +
+                           row_sum_.size() + power_.size()) +
+    sizeof(float) * (window_.size() + rows_.size());
+}
+
+} // ::util
@@ -0,0 +1,85 @@
+#include "util/task_queue.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+
+namespace util {
+
+TaskQueue::TaskQueue() : stop_(true)
+{
+}
+
+TaskQueue::~TaskQueue()
+{
+  Stop();
+}
+
+void TaskQueue::Start(int num_workers)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (!workers_.empty()) return;
+
+  stop_ = false;
+
+  for (int i = 0; i < std::max(num_workers, 1); ++i) {
+    workers_.push_back(std::thread(&TaskQueue::WorkLoop, this));
+  }
+}
+
+bool TaskQueue::Post(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (stop_) return false;
+
+    tasks_.push_back(std::move(task));
+  }
+
+  cv_.notify_one();
+  return true;
+}
+
+void TaskQueue::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+
+  cv_.notify_all();
+
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+
+  workers_.clear();
+}
+
+int TaskQueue::queued()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return tasks_.size();
+}
+
+void TaskQueue::WorkLoop()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (true) {
+
+    cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+
+    if (tasks_.empty()) break;
+
+    auto task = std::move(tasks_.front());
+    tasks_.pop_front();
+
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
+} // ::util
@@ -0,0 +1,140 @@
+#include "util/zero_suppress.hh"
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+inline unsigned short *Put32(unsigned short *p, unsigned int val)
+{
+  *(p++) = val & 0xffff;
+  *(p++) = val >> 16;
+  return p;
+}
+
+inline unsigned int Get32(const unsigned short *p)
+{
+  return (unsigned int)p[0] | ((unsigned int)p[1] << 16);
+}
+
+} // ::anonymous
+
+namespace util {
+
+int ZeroSuppressMaxWords(int num_ch, int len)
+{
+  // Windows don't overlap and touching ones are merged, so every
+  // window but the last is followed by a dropped sample.  Worst case
+  // is all samples kept in a window for every other sample.
+  return num_ch * (3 + len + 4 * ((len + 1) / 2));
+}
+
+int ZeroSuppress(const unsigned short *traces, int num_ch, int len,
+                 const zs_config &conf, unsigned short *out)
+{
+  unsigned short *p = out;
+  int pre_samples = std::max(0, conf.pre_samples);
+  int post_samples = std::max(0, conf.post_samples);
+
+  for (int ch = 0; ch < num_ch; ++ch) {
+
+    const unsigned short *x = traces + ch * len;
+    int nb = std::max(1, std::min(conf.baseline_samples, len));
+    double sum = 0.0;
+
+    for (int i = 0; i < nb; ++i) {
+      sum += x[i];
+    }
+
+    unsigned short baseline = (unsigned short)(sum / nb + 0.5);
+    int lo = (int)std::floor(baseline - conf.threshold);
+    int hi = (int)std::ceil(baseline + conf.threshold);
+
+    *(p++) = baseline;
+    unsigned short *pnum = p;
+    p += 2;
+
+    unsigned int num_windows = 0;
+    unsigned short *pwin = nullptr;
+    int last_stop = 0;
+    int i = 0;
+
+    while (i < len) {
+
+      // Find the next crossing.
+      while (i < len && x[i] >= lo && x[i] <= hi) ++i;
+      if (i == len) break;
+
+      // Never reach back into the previous window.
+      int start = std::max(last_stop, i - pre_samples);
+      int stop = std::min(len, i + 1 + post_samples);
+
+      // Extend the window while crossings keep showing up.
+      for (i = i + 1; i < stop; ++i) {
+        if (x[i] < lo || x[i] > hi) {
+          stop = std::min(len, i + 1 + post_samples);
+        }
+      }
+
+      if (pwin != nullptr && start == last_stop) {
+        // Touches the previous window, grow that one instead.
+        Put32(pwin + 2, stop - Get32(pwin));
+
+      } else {
+        pwin = p;
+        p = Put32(p, start);
+        p = Put32(p, stop - start);
+        num_windows++;
+      }
+
+      p = std::copy(x + start, x + stop, p);
+      last_stop = stop;
+    }
+
+    Put32(pnum, num_windows);
+  }
+
+  return p - out;
+}
+
+bool ZeroSuppressDecode(const unsigned short *in, int num_words,
+                        int num_ch, int len, unsigned short *traces)
+{
+  const unsigned short *p = in;
+  const unsigned short *end = in + num_words;
+
+  for (int ch = 0; ch < num_ch; ++ch) {
+
+    unsigned short *x = traces + ch * len;
+
+    if (end - p < 3) return false;
+
+    unsigned short baseline = *(p++);
+    unsigned int num_windows = Get32(p);
+    p += 2;
+
+    std::fill(x, x + len, baseline);
+
+    for (unsigned int w = 0; w < num_windows; ++w) {
+
+      if (end - p < 4) return false;
+
+      unsigned int start = Get32(p);
+      unsigned int length = Get32(p + 2);
+      p += 4;
+
+      if (start > (unsigned int)len || length > (unsigned int)len - start ||
+          end - p < (long)length) {
+        return false;
+      }
+
+      std::copy(p, p + length, x + start);
+      p += length;
+    }
+  }
+
+  return p == end;
+}
+
+} // ::util
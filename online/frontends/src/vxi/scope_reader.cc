@@ -1,4 +1,5 @@
 #include "scope_reader.h"
+#include "util/convert.hh"
 using namespace std;
 
 /*vxi11_user error codes:
@@ -104,14 +105,10 @@ int scope_reader::getWfm(char ch, int N, double* time, double* wfm, double& star
   char res[20011];
   int n = vxi11_receive(cl, res, 20011);
 
-  //Header has form #n<length of waveform><waveform>, where n is number of digits in <length of buffer>; this means header has n+2 chars, where n<=9. Waveform is returned as binary string with each data point containing 2 bytes. Use bitwise logic to convert pairs of bytes into a short and multiply by dV to get voltage in mV
+  //Header has form #n<length of waveform><waveform>, where n is number of digits in <length of buffer>; this means header has n+2 chars, where n<=9. Waveform is returned as binary string with each data point containing 2 bytes, LSB first (BYT_O LSB). Convert the pairs of bytes into shorts and multiply by dV to get voltage in mV
   int head = res[1] - '0' + 2;
-  for(int i=0; i<N; i++) {
-    short wfmbin = (res[2*i+head+1]<<8) | (res[2*i+head] & 255);
-    wfm[i] = wfmbin * dV;
-    time[i] = t0 + i*dt;
-    //if(i%100 == 0) cout << time[i] << ':' << wfm[i] << " , ";
-  }
+  util::ScaleI16Bytes(res + head, N, false, dV, 0.0, wfm);
+  util::Ramp(N, t0, dt, time);
   return n;
 }
 